@@ -15,6 +15,8 @@
 #ifndef OPEN_CORE_H
 #define OPEN_CORE_H
 
+#include <IndustryStandard/Acpi.h>
+
 #include <Library/OcBootManagementLib.h>
 #include <Library/OcConfigurationLib.h>
 #include <Library/OcCpuLib.h>
@@ -72,6 +74,12 @@
 
 #define OPEN_CORE_KEXT_PATH        L"Kexts\\"
 
+#define OPEN_CORE_KERNEL_CACHE_PATH L"KernelCache"
+
+#define OPEN_CORE_KERNEL_CACHE_FILE L"KernelCache\\Prelinked.bin"
+
+#define OPEN_CORE_KERNEL_HINTS_FILE L"KernelCache\\PatchHints.bin"
+
 #define OPEN_CORE_TOOL_PATH        L"Tools\\"
 
 #define OPEN_CORE_NVRAM_ATTR       (EFI_VARIABLE_BOOTSERVICE_ACCESS | EFI_VARIABLE_RUNTIME_ACCESS)
@@ -80,6 +88,289 @@
 
 #define OPEN_CORE_INT_NVRAM_ATTR   EFI_VARIABLE_BOOTSERVICE_ACCESS
 
+/**
+  Boot timing record variable name.
+**/
+#define OC_TIMING_VARIABLE_NAME    L"opencore-timing"
+
+/**
+  Boot timing record version, bump on incompatible changes.
+**/
+#define OC_TIMING_RECORD_VERSION   1
+
+/**
+  Boot timing spans. New spans must be appended before OcTimingMax.
+**/
+typedef enum {
+  OcTimingMiscEarlyInit,
+  OcTimingCpuScan,
+  OcTimingUefi,
+  OcTimingAcpi,
+  OcTimingPlatform,
+  OcTimingDevProps,
+  OcTimingNvram,
+  OcTimingMiscLateInit,
+  OcTimingKernelSupport,
+  OcTimingKernelRead,
+  OcTimingKernelPatch,
+  OcTimingKernelBlock,
+  OcTimingKernelInject,
+  OcTimingMax
+} OC_TIMING_SPAN;
+
+/**
+  Boot timing record stored in OC_TIMING_VARIABLE_NAME variable.
+**/
+typedef struct {
+  ///
+  /// OC_TIMING_RECORD_VERSION.
+  ///
+  UINT32  Version;
+  ///
+  /// Amount of spans in Ticks.
+  ///
+  UINT32  Count;
+  ///
+  /// TSC frequency in Hz, 0 when unknown.
+  ///
+  UINT64  TscFrequency;
+  ///
+  /// Accumulated TSC ticks per span.
+  ///
+  UINT64  Ticks[OcTimingMax];
+} OC_TIMING_RECORD;
+
+/**
+  Find and replace patch description for batched application.
+**/
+typedef struct {
+  ///
+  /// Data to find.
+  ///
+  CONST UINT8  *Find;
+  ///
+  /// Find mask, optional.
+  ///
+  CONST UINT8  *Mask;
+  ///
+  /// Replacement data.
+  ///
+  CONST UINT8  *Replace;
+  ///
+  /// Replacement mask, optional.
+  ///
+  CONST UINT8  *ReplaceMask;
+  ///
+  /// Size of Find, Replace and masks.
+  ///
+  UINT32       Size;
+  ///
+  /// Amount of occurrences to replace, 0 for all.
+  ///
+  UINT32       Count;
+  ///
+  /// Amount of occurrences to skip.
+  ///
+  UINT32       Skip;
+  ///
+  /// Maximum amount of bytes to look through, 0 for whole data.
+  ///
+  UINT32       Limit;
+  ///
+  /// Amount of replaced occurrences on success.
+  ///
+  UINT32       ReplaceCount;
+} OC_BATCH_PATCH;
+
+/**
+  Arena block, allocations follow the header.
+**/
+typedef struct OC_ARENA_BLOCK_ OC_ARENA_BLOCK;
+
+struct OC_ARENA_BLOCK_ {
+  ///
+  /// Next block in the arena.
+  ///
+  OC_ARENA_BLOCK   *Next;
+  ///
+  /// Block size in bytes including the header.
+  ///
+  UINTN            Size;
+  ///
+  /// Used bytes including the header.
+  ///
+  UINTN            Used;
+};
+
+/**
+  Arena allocator for data living as long as the configuration.
+  Allocations cannot be freed individually and are released all at once.
+**/
+typedef struct {
+  ///
+  /// Allocated blocks, current block goes first.
+  ///
+  OC_ARENA_BLOCK   *Blocks;
+  ///
+  /// Memory type of the blocks.
+  ///
+  EFI_MEMORY_TYPE  MemoryType;
+  ///
+  /// Size of the first block to allocate.
+  ///
+  UINTN            InitialSize;
+  ///
+  /// Amount of allocations served.
+  ///
+  UINT32           Allocations;
+  ///
+  /// Amount of blocks allocated.
+  ///
+  UINT32           BlockCount;
+} OC_ARENA;
+
+/**
+  Replaced occurrence of a batch patch.
+**/
+typedef struct {
+  ///
+  /// Patch index in the batch.
+  ///
+  UINT32       Patch;
+  ///
+  /// Occurrence offset in the data.
+  ///
+  UINT32       Offset;
+} OC_BATCH_PATCH_HINT;
+
+/**
+  Interned device path of device properties.
+**/
+typedef struct {
+  ///
+  /// Device path text from configuration.
+  ///
+  CONST CHAR8               *AsciiPath;
+  ///
+  /// Binary device path.
+  ///
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+} OC_DEVPROPS_DEVICE;
+
+/**
+  Device property with converted name.
+**/
+typedef struct {
+  ///
+  /// Interned device.
+  ///
+  CONST OC_DEVPROPS_DEVICE  *Device;
+  ///
+  /// Property name from configuration.
+  ///
+  CONST CHAR8               *AsciiName;
+  ///
+  /// Interned property name.
+  ///
+  CONST CHAR16              *Name;
+  ///
+  /// Property value, only for added properties.
+  ///
+  VOID                      *Value;
+  ///
+  /// Property value size.
+  ///
+  UINT32                    ValueSize;
+} OC_DEVPROPS_PROPERTY;
+
+/**
+  Device properties compiled from configuration.
+**/
+typedef struct {
+  ///
+  /// Interned devices shared by removed and added properties.
+  ///
+  OC_DEVPROPS_DEVICE    *Devices;
+  UINT32                DeviceCount;
+  ///
+  /// Properties to remove in configuration order.
+  ///
+  OC_DEVPROPS_PROPERTY  *Block;
+  UINT32                BlockCount;
+  ///
+  /// Properties to add in configuration order.
+  ///
+  OC_DEVPROPS_PROPERTY  *Add;
+  UINT32                AddCount;
+} OC_DEVPROPS_TABLE;
+
+/**
+  Maximum nesting of AML namespace paths.
+**/
+#define OC_AML_MAX_DEPTH  12
+
+/**
+  OperationRegion opcode in AML objects.
+**/
+#define OC_AML_REGION_OPCODE  0x5B80
+
+/**
+  Named object found in AML definition block.
+**/
+typedef struct {
+  ///
+  /// Table the object is defined in.
+  ///
+  CONST EFI_ACPI_DESCRIPTION_HEADER  *Table;
+  ///
+  /// Object opcode offset in the table.
+  ///
+  UINT32                             Offset;
+  ///
+  /// Object length in the table.
+  ///
+  UINT32                             Length;
+  ///
+  /// Name value or OperationRegion offset term offset in the table,
+  /// zero for other objects.
+  ///
+  UINT32                             DataOffset;
+  ///
+  /// Object opcode, extended opcodes include the prefix in high byte.
+  ///
+  UINT16                             Opcode;
+  ///
+  /// Amount of name segments in the path.
+  ///
+  UINT8                              Depth;
+  ///
+  /// Absolute object path.
+  ///
+  UINT32                             Path[OC_AML_MAX_DEPTH];
+} OC_AML_OBJECT;
+
+/**
+  Namespace index of AML definition blocks.
+**/
+typedef struct {
+  ///
+  /// Objects in definition order, parents go before their children.
+  ///
+  OC_AML_OBJECT  *Objects;
+  ///
+  /// Amount of objects.
+  ///
+  UINT32         Count;
+  ///
+  /// Amount of objects allocated.
+  ///
+  UINT32         Capacity;
+  ///
+  /// Amount of term lists not parsed till the end.
+  ///
+  UINT32         Incomplete;
+} OC_AML_NAMESPACE;
+
 /**
   Obtain cryptographic key if it was installed.
 
@@ -104,14 +395,46 @@ OcLoadAcpiSupport (
   IN OC_GLOBAL_CONFIG    *Config
   );
 
+/**
+  Overwrite ACPI table data and update the checksum incrementally
+  from the difference between old and new bytes.
+
+  @param[in,out] Table   ACPI table.
+  @param[in]     Offset  Data offset in the table, must not cover checksum.
+  @param[in]     Data    New data.
+  @param[in]     Size    New data size.
+**/
+VOID
+OcAcpiWriteTableData (
+  IN OUT EFI_ACPI_DESCRIPTION_HEADER  *Table,
+  IN     UINT32                       Offset,
+  IN     CONST VOID                   *Data,
+  IN     UINT32                       Size
+  );
+
+/**
+  Compile device properties from configuration, converting device paths
+  and property names once. Identical device paths and names are shared.
+
+  @param[in]      Config    OpenCore configuration.
+  @param[in,out]  Arena     Arena allocator for compiled data.
+  @param[out]     Table     Compiled device properties.
+**/
+VOID
+OcCompileDevProps (
+  IN     OC_GLOBAL_CONFIG   *Config,
+  IN OUT OC_ARENA           *Arena,
+  OUT    OC_DEVPROPS_TABLE  *Table
+  );
+
 /**
   Load device properties compatibility support.
 
-  @param[in]  Config    OpenCore configuration.
+  @param[in]  Table     Compiled device properties.
 **/
 VOID
 OcLoadDevPropsSupport (
-  IN OC_GLOBAL_CONFIG    *Config
+  IN CONST OC_DEVPROPS_TABLE  *Table
   );
 
 /**
@@ -136,6 +459,193 @@ OcUnloadKernelSupport (
   VOID
   );
 
+/**
+  Check whether prelinked kernel cache is enabled, i.e. whether
+  OPEN_CORE_KERNEL_CACHE_PATH directory exists in OpenCore storage.
+
+  @param[in]  Storage   OpenCore storage.
+
+  @retval TRUE when kernel cache may be used.
+**/
+BOOLEAN
+OcKernelCacheIsEnabled (
+  IN OC_STORAGE_CONTEXT  *Storage
+  );
+
+/**
+  Compute kernel cache key from kernel path, raw kernel, configuration,
+  enabled kexts, and CPU information. Configuration and kext plists are
+  hashed fully, raw kernel and kext executables are sampled along with
+  their size and modification time. Configuration and kext digest is
+  calculated once per boot.
+
+  @param[in]  Config    OpenCore configuration.
+  @param[in]  Storage   OpenCore storage.
+  @param[in]  CpuInfo   CPU information.
+  @param[in]  FileName  Raw kernel path.
+  @param[in]  File      Raw kernel file.
+  @param[out] Key       Cache key of SHA256_DIGEST_SIZE bytes.
+
+  @retval EFI_SUCCESS on success.
+**/
+EFI_STATUS
+OcKernelCacheGetKey (
+  IN  OC_GLOBAL_CONFIG    *Config,
+  IN  OC_STORAGE_CONTEXT  *Storage,
+  IN  OC_CPU_INFO         *CpuInfo,
+  IN  CONST CHAR16        *FileName,
+  IN  EFI_FILE_PROTOCOL   *File,
+  OUT UINT8               *Key
+  );
+
+/**
+  Load processed kernel from kernel cache.
+
+  @param[in]  Storage     OpenCore storage.
+  @param[in]  Key         Cache key.
+  @param[out] Kernel      Cached kernel allocated from pool.
+  @param[out] KernelSize  Cached kernel size.
+
+  @retval EFI_SUCCESS on success.
+  @retval EFI_NOT_FOUND when there is no cache or it has a different key.
+  @retval EFI_VOLUME_CORRUPTED when cache file is malformed.
+  @retval EFI_SECURITY_VIOLATION when cache does not match pinned digest.
+**/
+EFI_STATUS
+OcKernelCacheLoad (
+  IN  OC_STORAGE_CONTEXT  *Storage,
+  IN  CONST UINT8         *Key,
+  OUT UINT8               **Kernel,
+  OUT UINT32              *KernelSize
+  );
+
+/**
+  Save processed kernel to kernel cache replacing the previous one.
+  Only one kernel is kept, so that cache file and pinned digest
+  variable do not grow with the amount of kernel paths tried.
+
+  @param[in]  Storage     OpenCore storage.
+  @param[in]  Key         Cache key.
+  @param[in]  Kernel      Processed kernel.
+  @param[in]  KernelSize  Processed kernel size.
+**/
+VOID
+OcKernelCacheSave (
+  IN OC_STORAGE_CONTEXT  *Storage,
+  IN CONST UINT8         *Key,
+  IN UINT8               *Kernel,
+  IN UINT32              KernelSize
+  );
+
+/**
+  Calculate patch hint key for a batch of kernel patches.
+
+  @param[in]  Uuid        Kernel LC_UUID.
+  @param[in]  UuidSize    Kernel LC_UUID size.
+  @param[in]  DataSize    Size of patched data.
+  @param[in]  Patches     Batch patches.
+  @param[in]  PatchCount  Amount of patches.
+  @param[out] Key         Hint key, SHA-256 digest.
+**/
+VOID
+OcKernelCacheGetHintKey (
+  IN  CONST UINT8           *Uuid,
+  IN  UINT32                UuidSize,
+  IN  UINT32                DataSize,
+  IN  CONST OC_BATCH_PATCH  *Patches,
+  IN  UINT32                PatchCount,
+  OUT UINT8                 *Key
+  );
+
+/**
+  Load patch hint file from kernel cache.
+
+  @param[in]  Storage    OpenCore storage.
+  @param[out] Hints      Hint file allocated from pool.
+  @param[out] HintsSize  Hint file size.
+
+  @retval EFI_SUCCESS on success.
+**/
+EFI_STATUS
+OcKernelCacheLoadHints (
+  IN  OC_STORAGE_CONTEXT  *Storage,
+  OUT VOID                **Hints,
+  OUT UINT32              *HintsSize
+  );
+
+/**
+  Find patch hints by key in hint file.
+
+  @param[in]  Hints      Hint file.
+  @param[in]  HintsSize  Hint file size.
+  @param[in]  Key        Hint key.
+  @param[out] Entries    Replaced occurrences.
+  @param[out] Count      Amount of replaced occurrences.
+
+  @retval TRUE when found.
+**/
+BOOLEAN
+OcKernelCacheFindHints (
+  IN  CONST VOID                 *Hints,
+  IN  UINT32                     HintsSize,
+  IN  CONST UINT8                *Key,
+  OUT CONST OC_BATCH_PATCH_HINT  **Entries,
+  OUT UINT32                     *Count
+  );
+
+/**
+  Append patch hints to hint file, which is created when missing.
+
+  @param[in,out] Hints      Hint file allocated from pool.
+  @param[in,out] HintsSize  Hint file size.
+  @param[in]     Key        Hint key.
+  @param[in]     Entries    Replaced occurrences.
+  @param[in]     Count      Amount of replaced occurrences.
+
+  @retval EFI_SUCCESS on success.
+**/
+EFI_STATUS
+OcKernelCacheAddHints (
+  IN OUT VOID                       **Hints,
+  IN OUT UINT32                     *HintsSize,
+  IN     CONST UINT8                *Key,
+  IN     CONST OC_BATCH_PATCH_HINT  *Entries,
+  IN     UINT32                     Count
+  );
+
+/**
+  Append records from previous hint file, which are missing in hint file,
+  so that hints for other kernels are kept.
+
+  @param[in,out] Hints         Hint file allocated from pool.
+  @param[in,out] HintsSize     Hint file size.
+  @param[in]     OldHints      Previous hint file, optional.
+  @param[in]     OldHintsSize  Previous hint file size.
+
+  @retval EFI_SUCCESS on success.
+**/
+EFI_STATUS
+OcKernelCacheMergeHints (
+  IN OUT VOID        **Hints,
+  IN OUT UINT32      *HintsSize,
+  IN     CONST VOID  *OldHints,
+  IN     UINT32      OldHintsSize
+  );
+
+/**
+  Save patch hint file to kernel cache replacing the previous one.
+
+  @param[in]  Storage    OpenCore storage.
+  @param[in]  Hints      Hint file.
+  @param[in]  HintsSize  Hint file size.
+**/
+VOID
+OcKernelCacheSaveHints (
+  IN OC_STORAGE_CONTEXT  *Storage,
+  IN CONST VOID          *Hints,
+  IN UINT32              HintsSize
+  );
+
 /**
   Load NVRAM compatibility support.
 
@@ -250,6 +760,7 @@ OcMiscLateInit (
   @param[in]  StartImage      Image starting routine used.
   @param[in]  LoadHandle      OpenCore loading handle.
   @param[in]  CustomBootGuid  Use custom (gOcVendorVariableGuid) for Boot#### variables.
+  @param[in]  Arena           Arena allocator for picker data.
 **/
 VOID
 OcMiscBoot (
@@ -258,7 +769,8 @@ OcMiscBoot (
   IN  OC_PRIVILEGE_CONTEXT      *Privilege OPTIONAL,
   IN  OC_IMAGE_START            StartImage,
   IN  BOOLEAN                   CustomBootGuid,
-  IN  EFI_HANDLE                LoadHandle OPTIONAL
+  IN  EFI_HANDLE                LoadHandle OPTIONAL,
+  IN  OC_ARENA                  *Arena
   );
 
 /**
@@ -271,4 +783,218 @@ OcMiscUefiQuirksLoaded (
   IN OC_GLOBAL_CONFIG   *Config
   );
 
+/**
+  Start boot timing span.
+
+  @param[in]  Span      Span to start.
+**/
+VOID
+OcTimingStart (
+  IN OC_TIMING_SPAN  Span
+  );
+
+/**
+  Stop boot timing span, adding elapsed time to it.
+
+  @param[in]  Span      Span to stop.
+**/
+VOID
+OcTimingStop (
+  IN OC_TIMING_SPAN  Span
+  );
+
+/**
+  Report boot timing spans to log and OC_TIMING_VARIABLE_NAME variable.
+
+  @param[in]  TscFrequency  TSC frequency in Hz, 0 when unknown.
+**/
+VOID
+OcTimingExport (
+  IN UINT64  TscFrequency
+  );
+
+/**
+  Apply multiple find and replace patches in a single pass over the data.
+  Results match applying the patches one after another in array order with
+  ApplyPatch. When this cannot be guaranteed, for example when occurrences of
+  different patches overlap, the data is left untouched and EFI_ABORTED is
+  returned, so that the caller could fall back to sequential patching.
+
+  @param[in,out] Patches     Patches to apply, ReplaceCount is updated on success.
+  @param[in]     PatchCount  Amount of patches.
+  @param[in,out] Data        Data to patch.
+  @param[in]     DataSize    Data size.
+  @param[out]    Hints       Replaced occurrences allocated from pool, optional.
+  @param[out]    HintCount   Amount of replaced occurrences, optional.
+
+  @retval EFI_SUCCESS on success.
+  @retval EFI_ABORTED when patches interact with each other.
+  @retval EFI_OUT_OF_RESOURCES when memory allocation failed.
+**/
+EFI_STATUS
+OcApplyBatchPatches (
+  IN OUT OC_BATCH_PATCH       *Patches,
+  IN     UINT32               PatchCount,
+  IN OUT UINT8                *Data,
+  IN     UINT32               DataSize,
+  OUT    OC_BATCH_PATCH_HINT  **Hints      OPTIONAL,
+  OUT    UINT32               *HintCount   OPTIONAL
+  );
+
+/**
+  Apply batch patches at previously recorded occurrences. Every occurrence
+  is verified to match and to be the first one ApplyPatch would find before
+  any data is changed, so on mismatch the data is left untouched and
+  the caller should use OcApplyBatchPatches. Data between occurrences
+  is only searched for the anchor byte of each patch, and data after
+  the last occurrence of a patch which reached its Count is not searched.
+
+  @param[in,out] Patches     Patches to apply, ReplaceCount is updated on success.
+  @param[in]     PatchCount  Amount of patches.
+  @param[in,out] Data        Data to patch.
+  @param[in]     DataSize    Data size.
+  @param[in]     Hints       Occurrences from OcApplyBatchPatches.
+  @param[in]     HintCount   Amount of occurrences.
+
+  @retval EFI_SUCCESS on success.
+  @retval EFI_NOT_FOUND when occurrences do not match the data.
+  @retval EFI_ABORTED when patches interact with each other.
+  @retval EFI_OUT_OF_RESOURCES when memory allocation failed.
+**/
+EFI_STATUS
+OcApplyBatchPatchHints (
+  IN OUT OC_BATCH_PATCH             *Patches,
+  IN     UINT32                     PatchCount,
+  IN OUT UINT8                      *Data,
+  IN     UINT32                     DataSize,
+  IN     CONST OC_BATCH_PATCH_HINT  *Hints,
+  IN     UINT32                     HintCount
+  );
+
+/**
+  Initialise arena allocator.
+
+  @param[out] Arena        Arena allocator.
+  @param[in]  MemoryType   Memory type of arena blocks.
+  @param[in]  InitialSize  Expected total allocation size, used to size
+                           the first block, 0 for default block size.
+**/
+VOID
+OcArenaInit (
+  OUT OC_ARENA         *Arena,
+  IN  EFI_MEMORY_TYPE  MemoryType,
+  IN  UINTN            InitialSize
+  );
+
+/**
+  Allocate zeroed memory from arena allocator.
+
+  @param[in,out] Arena  Arena allocator.
+  @param[in]     Size   Allocation size.
+
+  @retval allocated memory or NULL.
+**/
+VOID *
+OcArenaAllocate (
+  IN OUT OC_ARENA  *Arena,
+  IN     UINTN     Size
+  );
+
+/**
+  Convert ASCII string to Unicode string allocated from arena allocator.
+
+  @param[in,out] Arena   Arena allocator.
+  @param[in]     String  ASCII string.
+
+  @retval Unicode string or NULL.
+**/
+CHAR16 *
+OcArenaAsciiToUnicode (
+  IN OUT OC_ARENA     *Arena,
+  IN     CONST CHAR8  *String
+  );
+
+/**
+  Free all arena allocations at once.
+
+  @param[in,out] Arena  Arena allocator.
+**/
+VOID
+OcArenaFree (
+  IN OUT OC_ARENA  *Arena
+  );
+
+/**
+  Add named objects of DSDT or SSDT to AML namespace index.
+  Method bodies and conditional blocks are only scanned for OperationRegion
+  definitions, field lists are skipped.
+
+  @param[in,out] Namespace  AML namespace, zeroed before first use.
+  @param[in]     Table      ACPI table.
+
+  @retval EFI_SUCCESS on success.
+  @retval EFI_UNSUPPORTED when table does not contain AML.
+  @retval EFI_OUT_OF_RESOURCES when memory allocation failed.
+**/
+EFI_STATUS
+OcAmlParseTable (
+  IN OUT OC_AML_NAMESPACE                   *Namespace,
+  IN     CONST EFI_ACPI_DESCRIPTION_HEADER  *Table
+  );
+
+/**
+  Read integer constant of Name or OperationRegion offset.
+
+  @param[in]  Object  AML object.
+  @param[out] Value   Integer value.
+  @param[out] Size    Encoded integer size, zero for Zero, One, and Ones.
+
+  @retval TRUE when object data is an integer constant.
+**/
+BOOLEAN
+OcAmlReadInteger (
+  IN  CONST OC_AML_OBJECT  *Object,
+  OUT UINT64               *Value,
+  OUT UINT32               *Size
+  );
+
+/**
+  Overwrite integer constant of Name or OperationRegion offset in place.
+  Table checksum is updated incrementally.
+
+  @param[in] Object  AML object.
+  @param[in] Value   New integer value.
+
+  @retval TRUE when the value fits the existing encoding and was written.
+**/
+BOOLEAN
+OcAmlWriteInteger (
+  IN CONST OC_AML_OBJECT  *Object,
+  IN UINT64               Value
+  );
+
+/**
+  Print object path in ASL notation, e.g. \_SB_.PCI0.LPCB.
+
+  @param[in]  Object      AML object.
+  @param[out] Buffer      Path buffer.
+  @param[in]  BufferSize  Path buffer size.
+**/
+VOID
+OcAmlGetObjectPath (
+  IN  CONST OC_AML_OBJECT  *Object,
+  OUT CHAR8                *Buffer,
+  IN  UINTN                BufferSize
+  );
+
+/**
+  Free AML namespace index.
+
+  @param[in,out] Namespace  AML namespace.
+**/
+VOID
+OcAmlFreeNamespace (
+  IN OUT OC_AML_NAMESPACE  *Namespace
+  );
+
 #endif // OPEN_CORE_H
@@ -22,6 +22,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Protocol/OcBootstrap.h>
 #include <Protocol/SimpleFileSystem.h>
 
+#include <Library/BaseLib.h>
 #include <Library/DebugLib.h>
 #include <Library/OcDebugLogLib.h>
 #include <Library/DevicePathLib.h>
@@ -55,6 +56,14 @@ STATIC
 OC_RSA_PUBLIC_KEY *
 mOpenCoreVaultKey;
 
+STATIC
+OC_ARENA
+mOpenCoreArena;
+
+STATIC
+OC_DEVPROPS_TABLE
+mOpenCoreDevProps;
+
 STATIC
 OC_PRIVILEGE_CONTEXT
 mOpenCorePrivilege;
@@ -102,6 +111,89 @@ OcStartImage (
   return Status;
 }
 
+/**
+  Estimate configuration lifetime arena usage, so that it fits in a single
+  block and a single memory map descriptor. Device paths are accounted by
+  their text size, which is larger than their binary form.
+
+  @param[in]  Config    OpenCore configuration.
+
+  @retval expected arena allocation size.
+**/
+STATIC
+UINTN
+OcEstimateArenaSize (
+  IN OC_GLOBAL_CONFIG  *Config
+  )
+{
+  UINTN   Size;
+  UINT32  BlockCount;
+  UINT32  AddCount;
+  UINT32  DeviceIndex;
+  UINT32  Index;
+  UINTN   Length;
+
+  //
+  // Every allocation may take up to 8 extra bytes for alignment.
+  //
+  Size       = 0;
+  BlockCount = 0;
+  AddCount   = 0;
+
+  for (DeviceIndex = 0; DeviceIndex < Config->DeviceProperties.Block.Count; ++DeviceIndex) {
+    Length  = AsciiStrSize (OC_BLOB_GET (Config->DeviceProperties.Block.Keys[DeviceIndex]));
+    Size   += 2 * (Length * sizeof (CHAR16) + sizeof (UINT64));
+    for (Index = 0; Index < Config->DeviceProperties.Block.Values[DeviceIndex]->Count; ++Index) {
+      Length  = AsciiStrSize (OC_BLOB_GET (Config->DeviceProperties.Block.Values[DeviceIndex]->Values[Index]));
+      Size   += Length * sizeof (CHAR16) + sizeof (UINT64);
+      ++BlockCount;
+    }
+  }
+
+  for (DeviceIndex = 0; DeviceIndex < Config->DeviceProperties.Add.Count; ++DeviceIndex) {
+    Length  = AsciiStrSize (OC_BLOB_GET (Config->DeviceProperties.Add.Keys[DeviceIndex]));
+    Size   += 2 * (Length * sizeof (CHAR16) + sizeof (UINT64));
+    for (Index = 0; Index < Config->DeviceProperties.Add.Values[DeviceIndex]->Count; ++Index) {
+      Length  = AsciiStrSize (OC_BLOB_GET (Config->DeviceProperties.Add.Values[DeviceIndex]->Keys[Index]));
+      Size   += Length * sizeof (CHAR16) + sizeof (UINT64);
+      ++AddCount;
+    }
+  }
+
+  if (BlockCount + AddCount > 0) {
+    Size += (Config->DeviceProperties.Block.Count + Config->DeviceProperties.Add.Count)
+      * sizeof (OC_DEVPROPS_DEVICE) + sizeof (UINT64);
+    Size += MAX (BlockCount, 1) * sizeof (OC_DEVPROPS_PROPERTY) + sizeof (UINT64);
+    Size += MAX (AddCount, 1) * sizeof (OC_DEVPROPS_PROPERTY) + sizeof (UINT64);
+  }
+
+  if (Config->Misc.BlessOverride.Count > 0) {
+    Size += Config->Misc.BlessOverride.Count * sizeof (CHAR16 *) + sizeof (UINT64);
+    for (Index = 0; Index < Config->Misc.BlessOverride.Count; ++Index) {
+      Length  = AsciiStrSize (OC_BLOB_GET (Config->Misc.BlessOverride.Values[Index]));
+      Size   += Length * sizeof (CHAR16) + sizeof (UINT64);
+    }
+  }
+
+  return Size;
+}
+
+/**
+  Release everything OcMain loaded from OpenCore storage. Kernel support
+  references storage and configuration, so it is unloaded first, and
+  the arena goes last as configuration lifetime data lives there.
+**/
+STATIC
+VOID
+OcMainUnload (
+  VOID
+  )
+{
+  OcUnloadKernelSupport ();
+  OcStorageFree (&mOpenCoreStorage);
+  OcArenaFree (&mOpenCoreArena);
+}
+
 STATIC
 VOID
 OcMain (
@@ -114,32 +206,60 @@ OcMain (
   OC_PRIVILEGE_CONTEXT      *Privilege;
 
   DEBUG ((DEBUG_INFO, "OC: OcMiscEarlyInit...\n"));
+  OcTimingStart (OcTimingMiscEarlyInit);
   Status = OcMiscEarlyInit (
     Storage,
     &mOpenCoreConfiguration,
     mOpenCoreVaultKey
     );
+  OcTimingStop (OcTimingMiscEarlyInit);
 
   if (EFI_ERROR (Status)) {
     return;
   }
 
+  OcArenaInit (
+    &mOpenCoreArena,
+    EfiBootServicesData,
+    OcEstimateArenaSize (&mOpenCoreConfiguration)
+    );
+
+  OcCompileDevProps (&mOpenCoreConfiguration, &mOpenCoreArena, &mOpenCoreDevProps);
+
+  OcTimingStart (OcTimingCpuScan);
   OcCpuScanProcessor (&mOpenCoreCpuInfo);
+  OcTimingStop (OcTimingCpuScan);
 
   DEBUG ((DEBUG_INFO, "OC: OcLoadUefiSupport...\n"));
+  OcTimingStart (OcTimingUefi);
   OcLoadUefiSupport (Storage, &mOpenCoreConfiguration, &mOpenCoreCpuInfo);
+  OcTimingStop (OcTimingUefi);
   DEBUG ((DEBUG_INFO, "OC: OcLoadAcpiSupport...\n"));
+  OcTimingStart (OcTimingAcpi);
   OcLoadAcpiSupport (&mOpenCoreStorage, &mOpenCoreConfiguration);
+  OcTimingStop (OcTimingAcpi);
   DEBUG ((DEBUG_INFO, "OC: OcLoadPlatformSupport...\n"));
+  OcTimingStart (OcTimingPlatform);
   OcLoadPlatformSupport (&mOpenCoreConfiguration, &mOpenCoreCpuInfo);
+  OcTimingStop (OcTimingPlatform);
   DEBUG ((DEBUG_INFO, "OC: OcLoadDevPropsSupport...\n"));
-  OcLoadDevPropsSupport (&mOpenCoreConfiguration);
+  OcTimingStart (OcTimingDevProps);
+  OcLoadDevPropsSupport (&mOpenCoreDevProps);
+  OcTimingStop (OcTimingDevProps);
   DEBUG ((DEBUG_INFO, "OC: OcLoadNvramSupport...\n"));
+  OcTimingStart (OcTimingNvram);
   OcLoadNvramSupport (Storage, &mOpenCoreConfiguration);
+  OcTimingStop (OcTimingNvram);
   DEBUG ((DEBUG_INFO, "OC: OcMiscLateInit...\n"));
+  OcTimingStart (OcTimingMiscLateInit);
   OcMiscLateInit (&mOpenCoreConfiguration, LoadPath, &LoadHandle);
+  OcTimingStop (OcTimingMiscLateInit);
   DEBUG ((DEBUG_INFO, "OC: OcLoadKernelSupport...\n"));
+  OcTimingStart (OcTimingKernelSupport);
   OcLoadKernelSupport (&mOpenCoreStorage, &mOpenCoreConfiguration, &mOpenCoreCpuInfo);
+  OcTimingStop (OcTimingKernelSupport);
+
+  OcTimingExport (mOpenCoreCpuInfo.TSCFrequency);
 
   if (mOpenCoreConfiguration.Misc.Security.EnablePassword) {
     mOpenCorePrivilege.CurrentLevel = OcPrivilegeUnauthorized;
@@ -160,7 +280,8 @@ OcMain (
     Privilege,
     OcStartImage,
     mOpenCoreConfiguration.Uefi.Quirks.RequestBootVarRouting,
-    LoadHandle
+    LoadHandle,
+    &mOpenCoreArena
     );
 }
 
@@ -191,7 +312,7 @@ OcBootstrapRerun (
 
     if (!EFI_ERROR (Status)) {
       OcMain (&mOpenCoreStorage, LoadPath);
-      OcStorageFree (&mOpenCoreStorage);
+      OcMainUnload ();
     } else {
       DEBUG ((DEBUG_ERROR, "OC: Failed to open root FS - %r!\n", Status));
       if (Status == EFI_SECURITY_VIOLATION) {
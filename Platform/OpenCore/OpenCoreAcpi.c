@@ -23,21 +23,257 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/PrintLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 
+/**
+  Terminator for table index chains.
+**/
+#define OC_ACPI_INDEX_END  MAX_UINT32
+
+///
+/// Signature index over ACPI context tables. DSDT is referenced from FADT
+/// and is not part of the table list, so it is not indexed.
+///
+typedef struct {
+  ///
+  /// First table per signature hash bucket.
+  ///
+  UINT32  *Heads;
+  ///
+  /// Next table with the same signature hash per table.
+  ///
+  UINT32  *Next;
+  ///
+  /// Amount of buckets, power of two.
+  ///
+  UINT32  Capacity;
+  ///
+  /// Amount of tables Next can hold.
+  ///
+  UINT32  TableCapacity;
+} OC_ACPI_TABLE_INDEX;
+
+STATIC
+UINT32
+OcAcpiIndexHash (
+  IN CONST OC_ACPI_TABLE_INDEX  *TableIndex,
+  IN UINT32                     Signature
+  )
+{
+  return ((Signature * 2654435761U) >> 16) & (TableIndex->Capacity - 1);
+}
+
+STATIC
+VOID
+OcAcpiIndexFree (
+  IN OUT OC_ACPI_TABLE_INDEX  *TableIndex
+  )
+{
+  if (TableIndex->Heads != NULL) {
+    FreePool (TableIndex->Heads);
+  }
+
+  if (TableIndex->Next != NULL) {
+    FreePool (TableIndex->Next);
+  }
+
+  ZeroMem (TableIndex, sizeof (*TableIndex));
+}
+
+STATIC
+VOID
+OcAcpiIndexAdd (
+  IN OUT OC_ACPI_TABLE_INDEX  *TableIndex,
+  IN     OC_ACPI_CONTEXT      *Context,
+  IN     UINT32               Table
+  )
+{
+  UINT32  Bucket;
+
+  Bucket                    = OcAcpiIndexHash (TableIndex, Context->Tables[Table]->Signature);
+  TableIndex->Next[Table]   = TableIndex->Heads[Bucket];
+  TableIndex->Heads[Bucket] = Table;
+}
+
+/**
+  Build table index, spare room is left for tables added later.
+  On failure the index stays empty and callers fall back to linear walks.
+**/
+STATIC
+VOID
+OcAcpiIndexBuild (
+  IN OUT OC_ACPI_TABLE_INDEX  *TableIndex,
+  IN     OC_ACPI_CONTEXT      *Context,
+  IN     UINT32               SpareTables
+  )
+{
+  UINT32  Index;
+
+  OcAcpiIndexFree (TableIndex);
+
+  TableIndex->TableCapacity = Context->NumberOfTables + SpareTables;
+  TableIndex->Capacity      = 1;
+  while (TableIndex->Capacity < TableIndex->TableCapacity * 2) {
+    TableIndex->Capacity <<= 1;
+  }
+
+  TableIndex->Heads = AllocatePool (TableIndex->Capacity * sizeof (*TableIndex->Heads));
+  TableIndex->Next  = AllocatePool (MAX (TableIndex->TableCapacity, 1) * sizeof (*TableIndex->Next));
+  if (TableIndex->Heads == NULL || TableIndex->Next == NULL) {
+    OcAcpiIndexFree (TableIndex);
+    return;
+  }
+
+  SetMem (TableIndex->Heads, TableIndex->Capacity * sizeof (*TableIndex->Heads), 0xFF);
+
+  for (Index = 0; Index < Context->NumberOfTables; ++Index) {
+    OcAcpiIndexAdd (TableIndex, Context, Index);
+  }
+}
+
+/**
+  Update table index after table insertion.
+**/
+STATIC
+VOID
+OcAcpiIndexUpdate (
+  IN OUT OC_ACPI_TABLE_INDEX  *TableIndex,
+  IN     OC_ACPI_CONTEXT      *Context,
+  IN     UINT32               OldNumberOfTables
+  )
+{
+  if (TableIndex->Heads != NULL
+    && Context->NumberOfTables == OldNumberOfTables + 1
+    && Context->NumberOfTables <= TableIndex->TableCapacity) {
+    OcAcpiIndexAdd (TableIndex, Context, OldNumberOfTables);
+  } else if (Context->NumberOfTables != OldNumberOfTables || TableIndex->Heads == NULL) {
+    OcAcpiIndexBuild (TableIndex, Context, Context->NumberOfTables);
+  }
+}
+
+/**
+  Find next table matching signature, length and OEM table id,
+  zero length and OEM table id match any table.
+
+  @param[in] TableIndex  Table index.
+  @param[in] Context     ACPI context.
+  @param[in] Table       Previous table or OC_ACPI_INDEX_END to start.
+  @param[in] Signature   Table signature.
+  @param[in] Length      Table length.
+  @param[in] OemTableId  Table OEM table id.
+
+  @retval table index or OC_ACPI_INDEX_END.
+**/
+STATIC
+UINT32
+OcAcpiIndexFind (
+  IN CONST OC_ACPI_TABLE_INDEX  *TableIndex,
+  IN OC_ACPI_CONTEXT            *Context,
+  IN UINT32                     Table,
+  IN UINT32                     Signature,
+  IN UINT32                     Length,
+  IN UINT64                     OemTableId
+  )
+{
+  EFI_ACPI_COMMON_HEADER  *Header;
+
+  if (Table == OC_ACPI_INDEX_END) {
+    Table = TableIndex->Heads[OcAcpiIndexHash (TableIndex, Signature)];
+  } else {
+    Table = TableIndex->Next[Table];
+  }
+
+  for (; Table != OC_ACPI_INDEX_END; Table = TableIndex->Next[Table]) {
+    Header = Context->Tables[Table];
+
+    if (Header->Signature != Signature
+      || (Length != 0 && Header->Length != Length)) {
+      continue;
+    }
+
+    if (OemTableId != 0
+      && (Header->Length < sizeof (EFI_ACPI_DESCRIPTION_HEADER)
+        || ((EFI_ACPI_DESCRIPTION_HEADER *) Header)->OemTableId != OemTableId)) {
+      continue;
+    }
+
+    return Table;
+  }
+
+  return OC_ACPI_INDEX_END;
+}
+
+/**
+  Report tables with invalid checksums. Incremental checksum updates
+  keep invalid firmware checksums invalid, so this is only done in
+  debug builds.
+**/
+STATIC
+VOID
+OcAcpiVerifyChecksum (
+  IN CONST EFI_ACPI_COMMON_HEADER  *Table
+  )
+{
+  if (Table != NULL
+    && Table->Length >= sizeof (EFI_ACPI_DESCRIPTION_HEADER)
+    && CalculateSum8 ((CONST UINT8 *) Table, Table->Length) != 0) {
+    DEBUG ((DEBUG_WARN, "OC: ACPI %08X has invalid checksum\n", Table->Signature));
+  }
+}
+
+VOID
+OcAcpiWriteTableData (
+  IN OUT EFI_ACPI_DESCRIPTION_HEADER  *Table,
+  IN     UINT32                       Offset,
+  IN     CONST VOID                   *Data,
+  IN     UINT32                       Size
+  )
+{
+  UINT8  *Target;
+  UINT8  Delta;
+
+  ASSERT (Offset >= OFFSET_OF (EFI_ACPI_DESCRIPTION_HEADER, Checksum) + sizeof (Table->Checksum)
+    || Offset + Size <= OFFSET_OF (EFI_ACPI_DESCRIPTION_HEADER, Checksum));
+
+  Target = (UINT8 *) Table + Offset;
+  Delta  = CalculateSum8 (Target, Size);
+  CopyMem (Target, Data, Size);
+  Delta  = (UINT8) (Delta - CalculateSum8 (Target, Size));
+
+  Table->Checksum = (UINT8) (Table->Checksum + Delta);
+}
+
+/**
+  Add tables from configuration and remember their copies in the context.
+
+  @param[in]     Config      OpenCore configuration.
+  @param[in]     Storage     OpenCore storage.
+  @param[in]     Context     ACPI context.
+  @param[in,out] TableIndex  Table index.
+  @param[out]    Added       Added tables still referenced by the context.
+  @param[out]    AddedCount  Amount of added tables.
+**/
 STATIC
 VOID
 OcAcpiAddTables (
-  IN OC_GLOBAL_CONFIG    *Config,
-  IN OC_STORAGE_CONTEXT  *Storage,
-  IN OC_ACPI_CONTEXT     *Context
+  IN     OC_GLOBAL_CONFIG        *Config,
+  IN     OC_STORAGE_CONTEXT      *Storage,
+  IN     OC_ACPI_CONTEXT         *Context,
+  IN OUT OC_ACPI_TABLE_INDEX     *TableIndex,
+  OUT    EFI_ACPI_COMMON_HEADER  **Added       OPTIONAL,
+  OUT    UINT32                  *AddedCount
   )
 {
-  EFI_STATUS           Status;
-  UINT8                *TableData;
-  UINT32               TableDataLength;
-  UINT32               Index;
-  OC_ACPI_ADD_ENTRY    *Table;
-  CONST CHAR8          *TablePath;
-  CHAR16               FullPath[128];
+  EFI_STATUS              Status;
+  UINT32                  NumberOfTables;
+  EFI_ACPI_COMMON_HEADER  *Dsdt;
+  UINT8                   *TableData;
+  UINT32                  TableDataLength;
+  UINT32                  Index;
+  UINT32                  Entry;
+  OC_ACPI_ADD_ENTRY       *Table;
+  CONST CHAR8             *TablePath;
+  CHAR16                  FullPath[128];
+
+  *AddedCount = 0;
 
   for (Index = 0; Index < Config->Acpi.Add.Count; ++Index) {
     Table = Config->Acpi.Add.Values[Index];
@@ -62,7 +298,10 @@ OcAcpiAddTables (
       continue;
     }
 
-    Status = AcpiInsertTable (Context, TableData, TableDataLength);
+    NumberOfTables = Context->NumberOfTables;
+    Dsdt           = Context->Dsdt;
+    Status         = AcpiInsertTable (Context, TableData, TableDataLength);
+    OcAcpiIndexUpdate (TableIndex, Context, NumberOfTables);
 
     if (EFI_ERROR (Status)) {
       DEBUG ((
@@ -71,6 +310,25 @@ OcAcpiAddTables (
         TablePath,
         Status
         ));
+    } else if (Added != NULL) {
+      //
+      // Replaced DSDT is the only insertion, which does not grow the table
+      // list. DSDT added earlier is no longer referenced by the context.
+      //
+      if (Context->NumberOfTables == NumberOfTables + 1) {
+        Entry = *AddedCount;
+        Added[Entry] = Context->Tables[NumberOfTables];
+      } else if (Context->Dsdt != Dsdt && Context->Dsdt != NULL) {
+        for (Entry = 0; Entry < *AddedCount && Added[Entry] != Dsdt; ++Entry) {
+        }
+        Added[Entry] = Context->Dsdt;
+      } else {
+        continue;
+      }
+
+      if (Entry == *AddedCount) {
+        ++(*AddedCount);
+      }
     }
   }
 }
@@ -78,12 +336,14 @@ OcAcpiAddTables (
 STATIC
 VOID
 OcAcpiBlockTables (
-  IN OC_GLOBAL_CONFIG    *Config,
-  IN OC_ACPI_CONTEXT     *Context
+  IN     OC_GLOBAL_CONFIG     *Config,
+  IN     OC_ACPI_CONTEXT      *Context,
+  IN OUT OC_ACPI_TABLE_INDEX  *TableIndex
   )
 {
   EFI_STATUS           Status;
   UINT32               Index;
+  UINT32               NumberOfTables;
   UINT32               Signature;
   UINT64               OemTableId;
   OC_ACPI_BLOCK_ENTRY  *Table;
@@ -98,13 +358,30 @@ OcAcpiBlockTables (
     CopyMem (&Signature, Table->TableSignature, sizeof (Table->TableSignature));
     CopyMem (&OemTableId, Table->OemTableId, sizeof (Table->OemTableId));
 
-    Status = AcpiDropTable (
-      Context,
-      Signature,
-      Table->TableLength,
-      OemTableId,
-      Table->All
-      );
+    //
+    // Skip the linear walk in AcpiDropTable when nothing can match.
+    // Matching tables are still dropped by AcpiDropTable, which owns
+    // RSDT and XSDT entry removal, so only missing tables are faster.
+    //
+    if (TableIndex->Heads != NULL
+      && Signature != 0
+      && Signature != EFI_ACPI_6_2_DIFFERENTIATED_SYSTEM_DESCRIPTION_TABLE_SIGNATURE
+      && OcAcpiIndexFind (TableIndex, Context, OC_ACPI_INDEX_END, Signature, Table->TableLength, OemTableId)
+        == OC_ACPI_INDEX_END) {
+      Status = EFI_NOT_FOUND;
+    } else {
+      NumberOfTables = Context->NumberOfTables;
+      Status = AcpiDropTable (
+        Context,
+        Signature,
+        Table->TableLength,
+        OemTableId,
+        Table->All
+        );
+      if (Context->NumberOfTables != NumberOfTables) {
+        OcAcpiIndexBuild (TableIndex, Context, Config->Acpi.Add.Count);
+      }
+    }
 
     if (EFI_ERROR (Status)) {
       DEBUG ((
@@ -120,17 +397,236 @@ OcAcpiBlockTables (
   }
 }
 
+///
+/// ACPI patch compiled for batched application.
+///
+typedef struct {
+  ///
+  /// Index in configuration.
+  ///
+  UINT32          Index;
+  ///
+  /// Table filter, zero values match any table.
+  ///
+  UINT32          TableSignature;
+  UINT32          TableLength;
+  UINT64          OemTableId;
+  ///
+  /// Find and replace pattern.
+  ///
+  OC_BATCH_PATCH  Patch;
+  ///
+  /// Replaced occurrences in all tables.
+  ///
+  UINT32          Matches;
+} OC_ACPI_PATCH_INFO;
+
+STATIC
+BOOLEAN
+OcAcpiPatchMatchesTable (
+  IN CONST OC_ACPI_PATCH_INFO      *Patch,
+  IN CONST EFI_ACPI_COMMON_HEADER  *Table
+  )
+{
+  if (Patch->TableSignature != 0 && Patch->TableSignature != Table->Signature) {
+    return FALSE;
+  }
+
+  if (Patch->TableLength != 0 && Patch->TableLength != Table->Length) {
+    return FALSE;
+  }
+
+  if (Patch->OemTableId != 0
+    && (Table->Length < sizeof (EFI_ACPI_DESCRIPTION_HEADER)
+      || ((CONST EFI_ACPI_DESCRIPTION_HEADER *) Table)->OemTableId != Patch->OemTableId)) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+  Accumulate checksum change of replaced occurrences. Unmasked patches
+  change every occurrence by the same amount, masked patches and patches
+  covering the checksum itself need the table to be summed again.
+
+  @retval TRUE when checksum delta is known.
+**/
+STATIC
+BOOLEAN
+OcAcpiPatchChecksumDelta (
+  IN     CONST OC_BATCH_PATCH       *Batch,
+  IN     CONST OC_BATCH_PATCH_HINT  *Hints,
+  IN     UINT32                     HintCount,
+  IN OUT UINT8                      *Delta
+  )
+{
+  UINT32                Index;
+  CONST OC_BATCH_PATCH  *Patch;
+
+  for (Index = 0; Index < HintCount; ++Index) {
+    Patch = &Batch[Hints[Index].Patch];
+
+    if (Patch->Mask != NULL || Patch->ReplaceMask != NULL
+      || (Hints[Index].Offset <= OFFSET_OF (EFI_ACPI_DESCRIPTION_HEADER, Checksum)
+        && Hints[Index].Offset + Patch->Size > OFFSET_OF (EFI_ACPI_DESCRIPTION_HEADER, Checksum))) {
+      return FALSE;
+    }
+
+    *Delta = (UINT8) (*Delta + CalculateSum8 (Patch->Find, Patch->Size) - CalculateSum8 (Patch->Replace, Patch->Size));
+  }
+
+  return TRUE;
+}
+
+/**
+  Apply all patches targeting the table in a single pass over it,
+  and update the checksum once when anything was replaced.
+**/
+STATIC
+VOID
+OcAcpiPatchTable (
+  IN OUT OC_ACPI_PATCH_INFO      *Patches,
+  IN     UINT32                  PatchCount,
+  IN     CONST BOOLEAN           *Targets,
+  IN OUT EFI_ACPI_COMMON_HEADER  *Table,
+  IN OUT OC_BATCH_PATCH          *Batch,
+  IN OUT UINT32                  *BatchIndices
+  )
+{
+  EFI_STATUS                   Status;
+  EFI_ACPI_DESCRIPTION_HEADER  *Header;
+  UINT32                       Index;
+  UINT32                       BatchCount;
+  UINT32                       Replaced;
+  BOOLEAN                      HasDelta;
+  UINT8                        Delta;
+  OC_BATCH_PATCH_HINT          *Hints;
+  UINT32                       HintCount;
+  UINT32                       Hinted;
+
+  if (Table->Length < sizeof (EFI_ACPI_DESCRIPTION_HEADER)) {
+    return;
+  }
+
+  Header = (EFI_ACPI_DESCRIPTION_HEADER *) Table;
+
+  BatchCount = 0;
+  for (Index = 0; Index < PatchCount; ++Index) {
+    if (Targets[Index]) {
+      CopyMem (&Batch[BatchCount], &Patches[Index].Patch, sizeof (Batch[BatchCount]));
+      BatchIndices[BatchCount] = Index;
+      ++BatchCount;
+    }
+  }
+
+  if (BatchCount == 0) {
+    return;
+  }
+
+  Hints     = NULL;
+  HintCount = 0;
+  HasDelta  = TRUE;
+  Delta     = 0;
+  Hinted    = 0;
+
+  Status = OcApplyBatchPatches (Batch, BatchCount, (UINT8 *) Table, Table->Length, &Hints, &HintCount);
+
+  if (Hints != NULL) {
+    HasDelta = OcAcpiPatchChecksumDelta (Batch, Hints, HintCount, &Delta);
+    Hinted   = HintCount;
+    FreePool (Hints);
+    Hints = NULL;
+  }
+
+  if (EFI_ERROR (Status)) {
+    //
+    // Patches interact with each other, apply them one by one in order.
+    //
+    DEBUG ((DEBUG_INFO, "OC: ACPI %08X falls back for %u patches - %r\n", Table->Signature, BatchCount, Status));
+    for (Index = 0; Index < BatchCount; ++Index) {
+      HintCount = 0;
+      Status    = OcApplyBatchPatches (&Batch[Index], 1, (UINT8 *) Table, Table->Length, &Hints, &HintCount);
+      if (EFI_ERROR (Status)) {
+        Batch[Index].ReplaceCount = 0;
+      }
+
+      if (Hints != NULL) {
+        HasDelta = HasDelta && OcAcpiPatchChecksumDelta (&Batch[Index], Hints, HintCount, &Delta);
+        Hinted  += HintCount;
+        FreePool (Hints);
+        Hints = NULL;
+      }
+    }
+  }
+
+  Replaced = 0;
+  for (Index = 0; Index < BatchCount; ++Index) {
+    Patches[BatchIndices[Index]].Matches += Batch[Index].ReplaceCount;
+    Replaced += Batch[Index].ReplaceCount;
+  }
+
+  //
+  // Every replaced occurrence must be accounted for to trust the delta.
+  //
+  if (Replaced > 0 && HasDelta && Hinted == Replaced) {
+    Header->Checksum = (UINT8) (Header->Checksum + Delta);
+  } else if (Replaced > 0) {
+    Header->Checksum = 0;
+    Header->Checksum = CalculateCheckSum8 ((UINT8 *) Header, Header->Length);
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "OC: ACPI %08X of %u bytes scanned once for %u patches, %u replaced\n",
+    Table->Signature,
+    Table->Length,
+    BatchCount,
+    Replaced
+    ));
+}
+
 STATIC
 VOID
 OcAcpiPatchTables (
-  IN OC_GLOBAL_CONFIG    *Config,
-  IN OC_ACPI_CONTEXT     *Context
+  IN OC_GLOBAL_CONFIG           *Config,
+  IN OC_ACPI_CONTEXT            *Context,
+  IN CONST OC_ACPI_TABLE_INDEX  *TableIndex
   )
 {
-  EFI_STATUS           Status;
   UINT32               Index;
+  UINT32               Table;
+  UINT32               PatchCount;
+  BOOLEAN              *Targets;
+  BOOLEAN              Targeted;
   OC_ACPI_PATCH_ENTRY  *UserPatch;
-  OC_ACPI_PATCH        Patch;
+  OC_ACPI_PATCH_INFO   *Patches;
+  OC_ACPI_PATCH_INFO   *Patch;
+  OC_BATCH_PATCH       *Batch;
+  UINT32               *BatchIndices;
+
+  if (Config->Acpi.Patch.Count == 0) {
+    return;
+  }
+
+  Patches      = AllocatePool (Config->Acpi.Patch.Count * sizeof (*Patches));
+  Batch        = AllocatePool (Config->Acpi.Patch.Count * sizeof (*Batch));
+  BatchIndices = AllocatePool (Config->Acpi.Patch.Count * sizeof (*BatchIndices));
+  if (Patches == NULL || Batch == NULL || BatchIndices == NULL) {
+    DEBUG ((DEBUG_ERROR, "OC: Failed to allocate ACPI patches\n"));
+    if (Patches != NULL) {
+      FreePool (Patches);
+    }
+    if (Batch != NULL) {
+      FreePool (Batch);
+    }
+    if (BatchIndices != NULL) {
+      FreePool (BatchIndices);
+    }
+    return;
+  }
+
+  PatchCount = 0;
 
   for (Index = 0; Index < Config->Acpi.Patch.Count; ++Index) {
     UserPatch = Config->Acpi.Patch.Values[Index];
@@ -153,32 +649,210 @@ OcAcpiPatchTables (
       continue;
     }
 
-    ZeroMem (&Patch, sizeof (Patch));
+    Patch = &Patches[PatchCount];
+    ZeroMem (Patch, sizeof (*Patch));
 
-    Patch.Find  = OC_BLOB_GET (&UserPatch->Find);
-    Patch.Replace = OC_BLOB_GET (&UserPatch->Replace);
+    Patch->Index         = Index;
+    Patch->Patch.Find    = OC_BLOB_GET (&UserPatch->Find);
+    Patch->Patch.Replace = OC_BLOB_GET (&UserPatch->Replace);
 
     if (UserPatch->Mask.Size > 0) {
-      Patch.Mask  = OC_BLOB_GET (&UserPatch->Mask);
+      Patch->Patch.Mask  = OC_BLOB_GET (&UserPatch->Mask);
     }
 
     if (UserPatch->ReplaceMask.Size > 0) {
-      Patch.ReplaceMask = OC_BLOB_GET (&UserPatch->ReplaceMask);
+      Patch->Patch.ReplaceMask = OC_BLOB_GET (&UserPatch->ReplaceMask);
     }
 
-    Patch.Size        = UserPatch->Replace.Size;
-    Patch.Count       = UserPatch->Count;
-    Patch.Skip        = UserPatch->Skip;
-    Patch.Limit       = UserPatch->Limit;
-    CopyMem (&Patch.TableSignature, UserPatch->TableSignature, sizeof (UserPatch->TableSignature));
-    Patch.TableLength = UserPatch->TableLength;
-    CopyMem (&Patch.OemTableId, UserPatch->OemTableId, sizeof (UserPatch->OemTableId));
+    Patch->Patch.Size    = UserPatch->Replace.Size;
+    Patch->Patch.Count   = UserPatch->Count;
+    Patch->Patch.Skip    = UserPatch->Skip;
+    Patch->Patch.Limit   = UserPatch->Limit;
+    CopyMem (&Patch->TableSignature, UserPatch->TableSignature, sizeof (UserPatch->TableSignature));
+    Patch->TableLength   = UserPatch->TableLength;
+    CopyMem (&Patch->OemTableId, UserPatch->OemTableId, sizeof (UserPatch->OemTableId));
 
-    Status = AcpiApplyPatch (Context, &Patch);
-    if (EFI_ERROR (Status)) {
-      DEBUG ((DEBUG_WARN, "OC: ACPI patcher failed %u - %r\n", Index, Status));
+    ++PatchCount;
+  }
+
+  //
+  // Resolve target tables per patch, last row is for DSDT.
+  // Patches with signature only visit tables from the index.
+  //
+  Targets = NULL;
+  if (PatchCount > 0) {
+    Targets = AllocateZeroPool ((Context->NumberOfTables + 1) * PatchCount * sizeof (*Targets));
+    if (Targets == NULL) {
+      DEBUG ((DEBUG_ERROR, "OC: Failed to allocate ACPI patch targets\n"));
+      PatchCount = 0;
     }
   }
+
+  for (Index = 0; Index < PatchCount; ++Index) {
+    Patch = &Patches[Index];
+
+    if (Context->Dsdt != NULL) {
+      Targets[Context->NumberOfTables * PatchCount + Index] =
+        OcAcpiPatchMatchesTable (Patch, (EFI_ACPI_COMMON_HEADER *) Context->Dsdt);
+    }
+
+    if (Patch->TableSignature != 0 && TableIndex->Heads != NULL) {
+      Table = OC_ACPI_INDEX_END;
+      while (TRUE) {
+        Table = OcAcpiIndexFind (
+          TableIndex,
+          Context,
+          Table,
+          Patch->TableSignature,
+          Patch->TableLength,
+          Patch->OemTableId
+          );
+        if (Table == OC_ACPI_INDEX_END) {
+          break;
+        }
+        Targets[Table * PatchCount + Index] = TRUE;
+      }
+    } else {
+      for (Table = 0; Table < Context->NumberOfTables; ++Table) {
+        Targets[Table * PatchCount + Index] = OcAcpiPatchMatchesTable (Patch, Context->Tables[Table]);
+      }
+    }
+  }
+
+  //
+  // Tables are independent, so patching them one by one with every patch
+  // in order gives the same result as applying patches one by one.
+  //
+  for (Table = 0; PatchCount > 0 && Table <= Context->NumberOfTables; ++Table) {
+    Targeted = FALSE;
+    for (Index = 0; Index < PatchCount && !Targeted; ++Index) {
+      Targeted = Targets[Table * PatchCount + Index];
+    }
+
+    if (!Targeted) {
+      continue;
+    }
+
+    OcAcpiPatchTable (
+      Patches,
+      PatchCount,
+      &Targets[Table * PatchCount],
+      Table < Context->NumberOfTables
+        ? Context->Tables[Table] : (EFI_ACPI_COMMON_HEADER *) Context->Dsdt,
+      Batch,
+      BatchIndices
+      );
+  }
+
+  for (Index = 0; Index < PatchCount; ++Index) {
+    if (Patches[Index].Matches == 0) {
+      DEBUG ((DEBUG_WARN, "OC: ACPI patcher failed %u - %r\n", Patches[Index].Index, EFI_NOT_FOUND));
+    } else {
+      DEBUG ((DEBUG_INFO, "OC: ACPI patcher %u replaced %u\n", Patches[Index].Index, Patches[Index].Matches));
+    }
+  }
+
+  if (Targets != NULL) {
+    FreePool (Targets);
+  }
+
+  FreePool (Patches);
+  FreePool (Batch);
+  FreePool (BatchIndices);
+}
+
+/**
+  Index AML namespace of DSDT and SSDTs in the context.
+**/
+STATIC
+VOID
+OcAcpiIndexNamespace (
+  IN     OC_ACPI_CONTEXT   *Context,
+  IN OUT OC_AML_NAMESPACE  *Namespace
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      Index;
+
+  Status = EFI_SUCCESS;
+
+  if (Context->Dsdt != NULL) {
+    Status = OcAmlParseTable (Namespace, (EFI_ACPI_DESCRIPTION_HEADER *) Context->Dsdt);
+  }
+
+  for (Index = 0; Index < Context->NumberOfTables && Status != EFI_OUT_OF_RESOURCES; ++Index) {
+    Status = OcAmlParseTable (Namespace, (EFI_ACPI_DESCRIPTION_HEADER *) Context->Tables[Index]);
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "OC: ACPI namespace has %u objects, %u term lists skipped\n",
+    Namespace->Count,
+    Namespace->Incomplete
+    ));
+}
+
+/**
+  Update OperationRegion addresses in added tables to match the firmware
+  tables, whose regions may move between boots. Region offsets are known
+  from the namespace index, so no table is scanned again.
+
+  @param[in,out] Namespace      AML namespace with firmware objects first.
+  @param[in]     FirmwareCount  Amount of firmware objects in the namespace.
+**/
+STATIC
+VOID
+OcAcpiRebaseRegions (
+  IN OUT OC_AML_NAMESPACE  *Namespace,
+  IN     UINT32            FirmwareCount
+  )
+{
+  UINT32         Index;
+  UINT32         FirmwareIndex;
+  OC_AML_OBJECT  *Region;
+  OC_AML_OBJECT  *FirmwareRegion;
+  UINT64         Address;
+  UINT64         FirmwareAddress;
+  UINT32         Size;
+  CHAR8          Path[OC_AML_MAX_DEPTH * 5 + 2];
+
+  for (Index = FirmwareCount; Index < Namespace->Count; ++Index) {
+    Region = &Namespace->Objects[Index];
+
+    //
+    // Only SystemMemory regions are relocated by firmware.
+    //
+    if (Region->Opcode != OC_AML_REGION_OPCODE
+      || Region->DataOffset == 0
+      || ((CONST UINT8 *) Region->Table)[Region->DataOffset - 1] != 0
+      || !OcAmlReadInteger (Region, &Address, &Size)) {
+      continue;
+    }
+
+    for (FirmwareIndex = 0; FirmwareIndex < FirmwareCount; ++FirmwareIndex) {
+      FirmwareRegion = &Namespace->Objects[FirmwareIndex];
+      if (FirmwareRegion->Opcode == OC_AML_REGION_OPCODE
+        && FirmwareRegion->Depth == Region->Depth
+        && CompareMem (FirmwareRegion->Path, Region->Path, Region->Depth * sizeof (UINT32)) == 0) {
+        break;
+      }
+    }
+
+    if (FirmwareIndex == FirmwareCount
+      || !OcAmlReadInteger (FirmwareRegion, &FirmwareAddress, &Size)
+      || FirmwareAddress == Address) {
+      continue;
+    }
+
+    OcAmlGetObjectPath (Region, Path, sizeof (Path));
+
+    if (!OcAmlWriteInteger (Region, FirmwareAddress)) {
+      DEBUG ((DEBUG_INFO, "OC: ACPI region %a cannot hold %LX\n", Path, FirmwareAddress));
+      continue;
+    }
+
+    DEBUG ((DEBUG_INFO, "OC: ACPI region %a rebased %LX -> %LX\n", Path, Address, FirmwareAddress));
+  }
 }
 
 VOID
@@ -187,8 +861,15 @@ OcLoadAcpiSupport (
   IN OC_GLOBAL_CONFIG    *Config
   )
 {
-  EFI_STATUS        Status;
-  OC_ACPI_CONTEXT   Context;
+  EFI_STATUS              Status;
+  OC_ACPI_CONTEXT         Context;
+  OC_ACPI_TABLE_INDEX     TableIndex;
+  EFI_ACPI_COMMON_HEADER  **Added;
+  UINT32                  AddedCount;
+  OC_AML_NAMESPACE        Namespace;
+  UINT32                  FirmwareCount;
+  BOOLEAN                 LibraryRegions;
+  UINT32                  Index;
 
   Status = AcpiInitContext (&Context);
 
@@ -197,15 +878,40 @@ OcLoadAcpiSupport (
     return;
   }
 
+  ZeroMem (&TableIndex, sizeof (TableIndex));
+  OcAcpiIndexBuild (&TableIndex, &Context, Config->Acpi.Add.Count);
+
+  ZeroMem (&Namespace, sizeof (Namespace));
   if (Config->Acpi.Quirks.RebaseRegions) {
+    OcAcpiIndexNamespace (&Context, &Namespace);
+  }
+  FirmwareCount = Namespace.Count;
+
+  //
+  // Firmware regions in term lists the parser cannot skip are unknown,
+  // so fall back to scanning the tables for them.
+  //
+  LibraryRegions = Config->Acpi.Quirks.RebaseRegions && Namespace.Incomplete > 0;
+  if (LibraryRegions) {
+    DEBUG ((DEBUG_INFO, "OC: ACPI namespace is incomplete, rebasing regions by table scan\n"));
     AcpiLoadRegions (&Context);
   }
 
-  OcAcpiPatchTables (Config, &Context);
+  OcAcpiPatchTables (Config, &Context, &TableIndex);
+
+  OcAcpiBlockTables (Config, &Context, &TableIndex);
+
+  //
+  // Added tables are only tracked for rebasing their regions.
+  //
+  Added = NULL;
+  if (Config->Acpi.Quirks.RebaseRegions && !LibraryRegions && Config->Acpi.Add.Count > 0) {
+    Added = AllocatePool (Config->Acpi.Add.Count * sizeof (*Added));
+  }
 
-  OcAcpiBlockTables (Config, &Context);
+  OcAcpiAddTables (Config, Storage, &Context, &TableIndex, Added, &AddedCount);
 
-  OcAcpiAddTables (Config, Storage, &Context);
+  OcAcpiIndexFree (&TableIndex);
 
   if (Config->Acpi.Quirks.FadtEnableReset) {
     AcpiFadtEnableReset (&Context);
@@ -220,14 +926,33 @@ OcLoadAcpiSupport (
   //
   AcpiHandleHardwareSignature (&Context, Config->Acpi.Quirks.ResetHwSig);
 
-  if (Config->Acpi.Quirks.RebaseRegions) {
+  if (LibraryRegions) {
     AcpiRelocateRegions (&Context);
+  } else if (Config->Acpi.Quirks.RebaseRegions && Added != NULL && FirmwareCount > 0) {
+    for (Index = 0; Index < AddedCount; ++Index) {
+      OcAmlParseTable (&Namespace, (EFI_ACPI_DESCRIPTION_HEADER *) Added[Index]);
+    }
+
+    OcAcpiRebaseRegions (&Namespace, FirmwareCount);
   }
 
+  OcAmlFreeNamespace (&Namespace);
+
   if (Config->Acpi.Quirks.NormalizeHeaders) {
     AcpiNormalizeHeaders (&Context);
   }
 
+  if (Added != NULL) {
+    FreePool (Added);
+  }
+
+  DEBUG_CODE_BEGIN ();
+  OcAcpiVerifyChecksum ((EFI_ACPI_COMMON_HEADER *) Context.Dsdt);
+  for (Index = 0; Index < Context.NumberOfTables; ++Index) {
+    OcAcpiVerifyChecksum (Context.Tables[Index]);
+  }
+  DEBUG_CODE_END ();
+
   AcpiApplyContext (&Context);
 
   AcpiFreeContext (&Context);
@@ -0,0 +1,813 @@
+/** @file
+  OpenCore driver.
+
+Copyright (c) 2019, vit9696. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <OpenCore.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+//
+// AML opcodes used by the namespace parser, see ACPI 6.2 section 20.
+//
+#define AML_ZERO_OP             0x00
+#define AML_ONE_OP              0x01
+#define AML_ALIAS_OP            0x06
+#define AML_NAME_OP             0x08
+#define AML_BYTE_PREFIX         0x0A
+#define AML_WORD_PREFIX         0x0B
+#define AML_DWORD_PREFIX        0x0C
+#define AML_STRING_PREFIX       0x0D
+#define AML_QWORD_PREFIX        0x0E
+#define AML_SCOPE_OP            0x10
+#define AML_BUFFER_OP           0x11
+#define AML_PACKAGE_OP          0x12
+#define AML_VAR_PACKAGE_OP      0x13
+#define AML_METHOD_OP           0x14
+#define AML_EXTERNAL_OP         0x15
+#define AML_DUAL_NAME_PREFIX    0x2E
+#define AML_MULTI_NAME_PREFIX   0x2F
+#define AML_EXT_OP              0x5B
+#define AML_ROOT_CHAR           0x5C
+#define AML_PARENT_PREFIX_CHAR  0x5E
+#define AML_IF_OP               0xA0
+#define AML_ELSE_OP             0xA1
+#define AML_WHILE_OP            0xA2
+#define AML_ONES_OP             0xFF
+
+#define AML_EXT_MUTEX_OP        0x01
+#define AML_EXT_EVENT_OP        0x02
+#define AML_EXT_REVISION_OP     0x30
+#define AML_EXT_REGION_OP       0x80
+#define AML_EXT_FIELD_OP        0x81
+#define AML_EXT_DEVICE_OP       0x82
+#define AML_EXT_PROCESSOR_OP    0x83
+#define AML_EXT_POWER_RES_OP    0x84
+#define AML_EXT_THERMAL_ZONE_OP 0x85
+#define AML_EXT_INDEX_FIELD_OP  0x86
+#define AML_EXT_BANK_FIELD_OP   0x87
+#define AML_EXT_DATA_REGION_OP  0x88
+
+/**
+  Initial amount of namespace objects.
+**/
+#define OC_AML_INITIAL_OBJECTS  256
+
+///
+/// AML stream position with current scope.
+///
+typedef struct {
+  CONST EFI_ACPI_DESCRIPTION_HEADER  *Table;
+  CONST UINT8                        *Start;
+  UINT8                              Depth;
+  UINT32                             Path[OC_AML_MAX_DEPTH];
+} OC_AML_SCOPE;
+
+/**
+  Decode PkgLength.
+
+  @param[in,out] Current  Stream position, moved past PkgLength.
+  @param[in]     End      Stream end.
+  @param[out]    PkgEnd   Package end.
+
+  @retval TRUE on success.
+**/
+STATIC
+BOOLEAN
+OcAmlParsePkgLength (
+  IN OUT CONST UINT8  **Current,
+  IN     CONST UINT8  *End,
+  OUT    CONST UINT8  **PkgEnd
+  )
+{
+  CONST UINT8  *Start;
+  UINT32       Length;
+  UINT32       Count;
+  UINT32       Index;
+
+  Start = *Current;
+  if (Start >= End) {
+    return FALSE;
+  }
+
+  Count = Start[0] >> 6U;
+  if ((UINTN) (End - Start) <= Count) {
+    return FALSE;
+  }
+
+  if (Count == 0) {
+    Length = Start[0] & 0x3FU;
+  } else {
+    Length = Start[0] & 0x0FU;
+    for (Index = 0; Index < Count; ++Index) {
+      Length |= (UINT32) Start[Index + 1] << (4U + Index * 8U);
+    }
+  }
+
+  if (Length <= Count || Length > (UINTN) (End - Start)) {
+    return FALSE;
+  }
+
+  *Current = Start + Count + 1;
+  *PkgEnd  = Start + Length;
+  return TRUE;
+}
+
+STATIC
+BOOLEAN
+OcAmlIsNameSeg (
+  IN CONST UINT8  *Current
+  )
+{
+  UINT32  Index;
+
+  if (!((Current[0] >= 'A' && Current[0] <= 'Z') || Current[0] == '_')) {
+    return FALSE;
+  }
+
+  for (Index = 1; Index < sizeof (UINT32); ++Index) {
+    if (!((Current[Index] >= 'A' && Current[Index] <= 'Z')
+      || (Current[Index] >= '0' && Current[Index] <= '9')
+      || Current[Index] == '_')) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/**
+  Decode NameString and resolve it against current scope.
+
+  @param[in,out] Current  Stream position, moved past NameString.
+  @param[in]     End      Stream end.
+  @param[in]     Scope    Current scope.
+  @param[out]    Depth    Resolved path depth, optional.
+  @param[out]    Path     Resolved path, optional.
+
+  @retval TRUE on success.
+**/
+STATIC
+BOOLEAN
+OcAmlParseNameString (
+  IN OUT CONST UINT8         **Current,
+  IN     CONST UINT8         *End,
+  IN     CONST OC_AML_SCOPE  *Scope,
+  OUT    UINT8               *Depth  OPTIONAL,
+  OUT    UINT32              *Path   OPTIONAL
+  )
+{
+  CONST UINT8  *Walker;
+  UINT32       PathDepth;
+  UINT32       SegCount;
+  UINT32       Index;
+
+  Walker    = *Current;
+  PathDepth = Scope->Depth;
+
+  if (Walker < End && *Walker == AML_ROOT_CHAR) {
+    PathDepth = 0;
+    ++Walker;
+  } else {
+    while (Walker < End && *Walker == AML_PARENT_PREFIX_CHAR) {
+      if (PathDepth == 0) {
+        return FALSE;
+      }
+      --PathDepth;
+      ++Walker;
+    }
+  }
+
+  if (Walker >= End) {
+    return FALSE;
+  }
+
+  if (*Walker == AML_ZERO_OP) {
+    SegCount = 0;
+    ++Walker;
+  } else if (*Walker == AML_DUAL_NAME_PREFIX) {
+    SegCount = 2;
+    ++Walker;
+  } else if (*Walker == AML_MULTI_NAME_PREFIX) {
+    if (End - Walker < 2) {
+      return FALSE;
+    }
+    SegCount = Walker[1];
+    Walker  += 2;
+  } else {
+    SegCount = 1;
+  }
+
+  if ((UINTN) (End - Walker) < SegCount * sizeof (UINT32)
+    || PathDepth + SegCount > OC_AML_MAX_DEPTH) {
+    return FALSE;
+  }
+
+  if (Path != NULL) {
+    CopyMem (Path, Scope->Path, PathDepth * sizeof (UINT32));
+  }
+
+  for (Index = 0; Index < SegCount; ++Index) {
+    if (!OcAmlIsNameSeg (Walker)) {
+      return FALSE;
+    }
+
+    if (Path != NULL) {
+      Path[PathDepth] = ReadUnaligned32 ((CONST UINT32 *) Walker);
+    }
+
+    ++PathDepth;
+    Walker += sizeof (UINT32);
+  }
+
+  if (Depth != NULL) {
+    *Depth = (UINT8) PathDepth;
+  }
+
+  *Current = Walker;
+  return TRUE;
+}
+
+/**
+  Skip DataRefObject or integer TermArg.
+
+  @param[in,out] Current  Stream position, moved past the object.
+  @param[in]     End      Stream end.
+  @param[in]     Scope    Current scope.
+
+  @retval TRUE on success.
+**/
+STATIC
+BOOLEAN
+OcAmlSkipData (
+  IN OUT CONST UINT8         **Current,
+  IN     CONST UINT8         *End,
+  IN     CONST OC_AML_SCOPE  *Scope
+  )
+{
+  CONST UINT8  *Walker;
+  CONST UINT8  *PkgEnd;
+  UINTN        Size;
+
+  Walker = *Current;
+  if (Walker >= End) {
+    return FALSE;
+  }
+
+  switch (*Walker) {
+    case AML_ZERO_OP:
+    case AML_ONE_OP:
+    case AML_ONES_OP:
+      Size = 1;
+      break;
+    case AML_BYTE_PREFIX:
+      Size = 2;
+      break;
+    case AML_WORD_PREFIX:
+      Size = 3;
+      break;
+    case AML_DWORD_PREFIX:
+      Size = 5;
+      break;
+    case AML_QWORD_PREFIX:
+      Size = 9;
+      break;
+    case AML_STRING_PREFIX:
+      for (Size = 1; Walker + Size < End && Walker[Size] != '\0'; ++Size) {
+      }
+      ++Size;
+      break;
+    case AML_BUFFER_OP:
+    case AML_PACKAGE_OP:
+    case AML_VAR_PACKAGE_OP:
+      ++Walker;
+      if (!OcAmlParsePkgLength (&Walker, End, &PkgEnd)) {
+        return FALSE;
+      }
+      *Current = PkgEnd;
+      return TRUE;
+    case AML_EXT_OP:
+      if (End - Walker < 2 || Walker[1] != AML_EXT_REVISION_OP) {
+        return FALSE;
+      }
+      Size = 2;
+      break;
+    default:
+      //
+      // Object reference.
+      //
+      return OcAmlParseNameString (Current, End, Scope, NULL, NULL);
+  }
+
+  if ((UINTN) (End - Walker) < Size) {
+    return FALSE;
+  }
+
+  *Current = Walker + Size;
+  return TRUE;
+}
+
+STATIC
+BOOLEAN
+OcAmlAddObject (
+  IN OUT OC_AML_NAMESPACE    *Namespace,
+  IN     CONST OC_AML_SCOPE  *Scope,
+  IN     UINT16              Opcode,
+  IN     CONST UINT8         *Start,
+  IN     CONST UINT8         *End,
+  IN     CONST UINT8         *Data    OPTIONAL,
+  IN     UINT8               Depth,
+  IN     CONST UINT32        *Path
+  )
+{
+  OC_AML_OBJECT  *Objects;
+  OC_AML_OBJECT  *Object;
+  UINT32         Capacity;
+
+  if (Namespace->Count == Namespace->Capacity) {
+    Capacity = MAX (Namespace->Capacity * 2, OC_AML_INITIAL_OBJECTS);
+    Objects  = ReallocatePool (
+      Namespace->Capacity * sizeof (*Objects),
+      Capacity * sizeof (*Objects),
+      Namespace->Objects
+      );
+    if (Objects == NULL) {
+      return FALSE;
+    }
+
+    Namespace->Objects  = Objects;
+    Namespace->Capacity = Capacity;
+  }
+
+  Object             = &Namespace->Objects[Namespace->Count];
+  Object->Table      = Scope->Table;
+  Object->Offset     = (UINT32) (Start - Scope->Start);
+  Object->Length     = (UINT32) (End - Start);
+  Object->DataOffset = Data != NULL ? (UINT32) (Data - Scope->Start) : 0;
+  Object->Opcode     = Opcode;
+  Object->Depth      = Depth;
+  CopyMem (Object->Path, Path, Depth * sizeof (UINT32));
+  ++Namespace->Count;
+
+  return TRUE;
+}
+
+/**
+  Index OperationRegion definitions in a term list, which cannot be parsed
+  term by term, by scanning it for region opcodes. Regions are resolved
+  against the given scope, as nested scopes are not known here.
+
+  @param[in,out] Namespace  AML namespace.
+  @param[in]     Scope      Enclosing scope.
+  @param[in]     Current    Term list start.
+  @param[in]     End        Term list end.
+
+  @retval EFI_SUCCESS on success.
+  @retval EFI_OUT_OF_RESOURCES when memory allocation failed.
+**/
+STATIC
+EFI_STATUS
+OcAmlScanRegions (
+  IN OUT OC_AML_NAMESPACE    *Namespace,
+  IN     CONST OC_AML_SCOPE  *Scope,
+  IN     CONST UINT8         *Current,
+  IN     CONST UINT8         *End
+  )
+{
+  CONST UINT8  *Body;
+  CONST UINT8  *Data;
+  UINT8        Depth;
+  UINT32       Path[OC_AML_MAX_DEPTH];
+
+  while (End - Current > 2) {
+    if (Current[0] != AML_EXT_OP || Current[1] != AML_EXT_REGION_OP) {
+      ++Current;
+      continue;
+    }
+
+    //
+    // NameString, RegionSpace, RegionOffset, RegionLen.
+    //
+    Body = Current + 2;
+    if (!OcAmlParseNameString (&Body, End, Scope, &Depth, Path)
+      || Body >= End) {
+      ++Current;
+      continue;
+    }
+
+    ++Body;
+    Data = Body;
+    if (!OcAmlSkipData (&Body, End, Scope)
+      || !OcAmlSkipData (&Body, End, Scope)) {
+      ++Current;
+      continue;
+    }
+
+    if (!OcAmlAddObject (Namespace, Scope, OC_AML_REGION_OPCODE, Current, Body, Data, Depth, Path)) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    Current = Body;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Stop parsing the rest of a term list at a term, which cannot be skipped,
+  and only look for regions in it.
+**/
+STATIC
+EFI_STATUS
+OcAmlAbortTermList (
+  IN OUT OC_AML_NAMESPACE    *Namespace,
+  IN     CONST OC_AML_SCOPE  *Scope,
+  IN     CONST UINT8         *Current,
+  IN     CONST UINT8         *End
+  )
+{
+  ++Namespace->Incomplete;
+  return OcAmlScanRegions (Namespace, Scope, Current, End);
+}
+
+/**
+  Index named objects in TermList.
+
+  @param[in,out] Namespace  AML namespace.
+  @param[in]     Scope      Current scope.
+  @param[in]     Current    TermList start.
+  @param[in]     End        TermList end.
+
+  @retval EFI_SUCCESS on success.
+  @retval EFI_OUT_OF_RESOURCES when memory allocation failed.
+**/
+STATIC
+EFI_STATUS
+OcAmlParseTermList (
+  IN OUT OC_AML_NAMESPACE    *Namespace,
+  IN     CONST OC_AML_SCOPE  *Scope,
+  IN     CONST UINT8         *Current,
+  IN     CONST UINT8         *End
+  )
+{
+  EFI_STATUS    Status;
+  CONST UINT8   *Start;
+  CONST UINT8   *Body;
+  CONST UINT8   *Data;
+  CONST UINT8   *PkgEnd;
+  UINT16        Opcode;
+  UINT32        Skip;
+  BOOLEAN       Descend;
+  BOOLEAN       Parsed;
+  OC_AML_SCOPE  Child;
+
+  Child.Table = Scope->Table;
+  Child.Start = Scope->Start;
+
+  while (Current < End) {
+    Start   = Current;
+    Opcode  = *Current++;
+    PkgEnd  = NULL;
+    Descend = FALSE;
+    Skip    = 0;
+
+    if (Opcode == AML_EXT_OP) {
+      if (Current >= End) {
+        break;
+      }
+      Opcode = (UINT16) ((AML_EXT_OP << 8U) | *Current++);
+    }
+
+    switch (Opcode) {
+      case AML_SCOPE_OP:
+      case (AML_EXT_OP << 8U) | AML_EXT_DEVICE_OP:
+      case (AML_EXT_OP << 8U) | AML_EXT_THERMAL_ZONE_OP:
+        Descend = TRUE;
+        break;
+      case (AML_EXT_OP << 8U) | AML_EXT_PROCESSOR_OP:
+        //
+        // ProcID, PblkAddr, PblkLen.
+        //
+        Descend = TRUE;
+        Skip    = 6;
+        break;
+      case (AML_EXT_OP << 8U) | AML_EXT_POWER_RES_OP:
+        //
+        // SystemLevel, ResourceOrder.
+        //
+        Descend = TRUE;
+        Skip    = 3;
+        break;
+      case AML_METHOD_OP:
+      case (AML_EXT_OP << 8U) | AML_EXT_FIELD_OP:
+      case (AML_EXT_OP << 8U) | AML_EXT_INDEX_FIELD_OP:
+      case (AML_EXT_OP << 8U) | AML_EXT_BANK_FIELD_OP:
+      case AML_IF_OP:
+      case AML_ELSE_OP:
+      case AML_WHILE_OP:
+      case AML_NAME_OP:
+      case AML_ALIAS_OP:
+      case AML_EXTERNAL_OP:
+      case OC_AML_REGION_OPCODE:
+      case (AML_EXT_OP << 8U) | AML_EXT_DATA_REGION_OP:
+      case (AML_EXT_OP << 8U) | AML_EXT_MUTEX_OP:
+      case (AML_EXT_OP << 8U) | AML_EXT_EVENT_OP:
+        break;
+      default:
+        //
+        // Other terms need a full AML interpreter to be skipped.
+        //
+        return OcAmlAbortTermList (Namespace, Scope, Start, End);
+    }
+
+    switch (Opcode) {
+      case AML_NAME_OP:
+      case AML_ALIAS_OP:
+      case AML_EXTERNAL_OP:
+      case OC_AML_REGION_OPCODE:
+      case (AML_EXT_OP << 8U) | AML_EXT_DATA_REGION_OP:
+      case (AML_EXT_OP << 8U) | AML_EXT_MUTEX_OP:
+      case (AML_EXT_OP << 8U) | AML_EXT_EVENT_OP:
+        Body = Current;
+        if (Opcode == AML_ALIAS_OP) {
+          //
+          // Alias source.
+          //
+          if (!OcAmlParseNameString (&Body, End, Scope, NULL, NULL)) {
+            return OcAmlAbortTermList (Namespace, Scope, Start, End);
+          }
+        }
+
+        if (!OcAmlParseNameString (&Body, End, Scope, &Child.Depth, Child.Path)) {
+          return OcAmlAbortTermList (Namespace, Scope, Start, End);
+        }
+
+        Data = NULL;
+        if (Opcode == AML_NAME_OP) {
+          Data   = Body;
+          Parsed = OcAmlSkipData (&Body, End, Scope);
+        } else if (Opcode == ((AML_EXT_OP << 8U) | AML_EXT_DATA_REGION_OP)) {
+          //
+          // SignatureString, OemIDString, OemTableIDString.
+          //
+          Parsed = OcAmlSkipData (&Body, End, Scope)
+            && OcAmlSkipData (&Body, End, Scope)
+            && OcAmlSkipData (&Body, End, Scope);
+        } else if (Opcode == OC_AML_REGION_OPCODE) {
+          //
+          // RegionSpace, RegionOffset, RegionLen.
+          //
+          ++Body;
+          Data   = Body;
+          Parsed = Body < End
+            && OcAmlSkipData (&Body, End, Scope)
+            && OcAmlSkipData (&Body, End, Scope);
+        } else {
+          //
+          // ObjectType and ArgumentCount for External, SyncFlags for Mutex.
+          //
+          Skip   = Opcode == AML_EXTERNAL_OP ? 2 : (Opcode == AML_ALIAS_OP || Opcode == ((AML_EXT_OP << 8U) | AML_EXT_EVENT_OP) ? 0 : 1);
+          Parsed = (UINTN) (End - Body) >= Skip;
+          Body  += Parsed ? Skip : 0;
+        }
+
+        if (!Parsed) {
+          return OcAmlAbortTermList (Namespace, Scope, Start, End);
+        }
+
+        if (Opcode != AML_EXTERNAL_OP
+          && !OcAmlAddObject (Namespace, Scope, Opcode, Start, Body, Data, Child.Depth, Child.Path)) {
+          return EFI_OUT_OF_RESOURCES;
+        }
+
+        Current = Body;
+        continue;
+      default:
+        break;
+    }
+
+    if (!OcAmlParsePkgLength (&Current, End, &PkgEnd)) {
+      return OcAmlAbortTermList (Namespace, Scope, Start, End);
+    }
+
+    if (Opcode == ((AML_EXT_OP << 8U) | AML_EXT_FIELD_OP)
+      || Opcode == ((AML_EXT_OP << 8U) | AML_EXT_INDEX_FIELD_OP)
+      || Opcode == ((AML_EXT_OP << 8U) | AML_EXT_BANK_FIELD_OP)) {
+      Current = PkgEnd;
+      continue;
+    }
+
+    if (Opcode == AML_IF_OP || Opcode == AML_ELSE_OP || Opcode == AML_WHILE_OP) {
+      //
+      // Conditional blocks do not open a scope, but may define regions.
+      //
+      Status = OcAmlScanRegions (Namespace, Scope, Current, PkgEnd);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+
+      Current = PkgEnd;
+      continue;
+    }
+
+    if (!OcAmlParseNameString (&Current, PkgEnd, Scope, &Child.Depth, Child.Path)
+      || (UINTN) (PkgEnd - Current) < Skip) {
+      return OcAmlAbortTermList (Namespace, Scope, Start, End);
+    }
+
+    if (!OcAmlAddObject (Namespace, Scope, Opcode, Start, PkgEnd, NULL, Child.Depth, Child.Path)) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    if (Descend) {
+      Status = OcAmlParseTermList (Namespace, &Child, Current + Skip, PkgEnd);
+    } else if (Opcode == AML_METHOD_OP && Current < PkgEnd) {
+      //
+      // Method bodies are not parsed, but regions defined there
+      // belong to the method scope. Skip MethodFlags.
+      //
+      Status = OcAmlScanRegions (Namespace, &Child, Current + 1, PkgEnd);
+    } else {
+      Status = EFI_SUCCESS;
+    }
+
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Current = PkgEnd;
+  }
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+OcAmlParseTable (
+  IN OUT OC_AML_NAMESPACE                   *Namespace,
+  IN     CONST EFI_ACPI_DESCRIPTION_HEADER  *Table
+  )
+{
+  EFI_STATUS    Status;
+  OC_AML_SCOPE  Scope;
+  UINT32        Count;
+
+  if ((Table->Signature != EFI_ACPI_6_2_DIFFERENTIATED_SYSTEM_DESCRIPTION_TABLE_SIGNATURE
+    && Table->Signature != EFI_ACPI_6_2_SECONDARY_SYSTEM_DESCRIPTION_TABLE_SIGNATURE)
+    || Table->Length < sizeof (*Table)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  ZeroMem (&Scope, sizeof (Scope));
+  Scope.Table = Table;
+  Scope.Start = (CONST UINT8 *) Table;
+  Count       = Namespace->Count;
+
+  Status = OcAmlParseTermList (
+    Namespace,
+    &Scope,
+    (CONST UINT8 *) (Table + 1),
+    (CONST UINT8 *) Table + Table->Length
+    );
+
+  DEBUG ((
+    DEBUG_VERBOSE,
+    "OC: AML %08X indexed %u objects - %r\n",
+    Table->Signature,
+    Namespace->Count - Count,
+    Status
+    ));
+
+  return Status;
+}
+
+BOOLEAN
+OcAmlReadInteger (
+  IN  CONST OC_AML_OBJECT  *Object,
+  OUT UINT64               *Value,
+  OUT UINT32               *Size
+  )
+{
+  CONST UINT8  *Data;
+  UINT32       Remaining;
+
+  if (Object->DataOffset == 0 || Object->DataOffset >= Object->Table->Length) {
+    return FALSE;
+  }
+
+  Data      = (CONST UINT8 *) Object->Table + Object->DataOffset;
+  Remaining = Object->Table->Length - Object->DataOffset;
+
+  switch (Data[0]) {
+    case AML_ZERO_OP:
+      *Value = 0;
+      *Size  = 0;
+      return TRUE;
+    case AML_ONE_OP:
+      *Value = 1;
+      *Size  = 0;
+      return TRUE;
+    case AML_ONES_OP:
+      *Value = MAX_UINT64;
+      *Size  = 0;
+      return TRUE;
+    case AML_BYTE_PREFIX:
+      *Size = sizeof (UINT8);
+      break;
+    case AML_WORD_PREFIX:
+      *Size = sizeof (UINT16);
+      break;
+    case AML_DWORD_PREFIX:
+      *Size = sizeof (UINT32);
+      break;
+    case AML_QWORD_PREFIX:
+      *Size = sizeof (UINT64);
+      break;
+    default:
+      return FALSE;
+  }
+
+  if (Remaining <= *Size) {
+    return FALSE;
+  }
+
+  *Value = 0;
+  CopyMem (Value, &Data[1], *Size);
+  return TRUE;
+}
+
+BOOLEAN
+OcAmlWriteInteger (
+  IN CONST OC_AML_OBJECT  *Object,
+  IN UINT64               Value
+  )
+{
+  UINT64  Current;
+  UINT32  Size;
+
+  if (!OcAmlReadInteger (Object, &Current, &Size)
+    || Size == 0
+    || (Size < sizeof (UINT64) && RShiftU64 (Value, Size * 8) != 0)) {
+    return FALSE;
+  }
+
+  OcAcpiWriteTableData (
+    (EFI_ACPI_DESCRIPTION_HEADER *) Object->Table,
+    Object->DataOffset + 1,
+    &Value,
+    Size
+    );
+  return TRUE;
+}
+
+VOID
+OcAmlGetObjectPath (
+  IN  CONST OC_AML_OBJECT  *Object,
+  OUT CHAR8                *Buffer,
+  IN  UINTN                BufferSize
+  )
+{
+  UINTN  Size;
+  UINT8  Index;
+
+  if (BufferSize < 2) {
+    return;
+  }
+
+  Buffer[0] = AML_ROOT_CHAR;
+  Size      = 1;
+
+  for (Index = 0; Index < Object->Depth && Size + 6 <= BufferSize; ++Index) {
+    if (Index > 0) {
+      Buffer[Size++] = '.';
+    }
+
+    CopyMem (&Buffer[Size], &Object->Path[Index], sizeof (UINT32));
+    Size += sizeof (UINT32);
+  }
+
+  Buffer[Size] = '\0';
+}
+
+VOID
+OcAmlFreeNamespace (
+  IN OUT OC_AML_NAMESPACE  *Namespace
+  )
+{
+  if (Namespace->Objects != NULL) {
+    FreePool (Namespace->Objects);
+  }
+
+  ZeroMem (Namespace, sizeof (*Namespace));
+}
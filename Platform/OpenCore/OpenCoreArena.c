@@ -0,0 +1,159 @@
+/** @file
+  OpenCore driver.
+
+Copyright (c) 2019, vit9696. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <OpenCore.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/UefiBootServicesTableLib.h>
+
+/**
+  Default arena block size, larger allocations get their own block.
+**/
+#define OC_ARENA_BLOCK_SIZE  EFI_PAGES_TO_SIZE (4)
+
+/**
+  Arena allocation alignment.
+**/
+#define OC_ARENA_ALIGNMENT   8
+
+VOID
+OcArenaInit (
+  OUT OC_ARENA         *Arena,
+  IN  EFI_MEMORY_TYPE  MemoryType,
+  IN  UINTN            InitialSize
+  )
+{
+  ZeroMem (Arena, sizeof (*Arena));
+  Arena->MemoryType  = MemoryType;
+  Arena->InitialSize = OC_ARENA_BLOCK_SIZE;
+
+  //
+  // Every block is a separate memory map descriptor, so try to fit
+  // everything in the first one.
+  //
+  if (InitialSize > OC_ARENA_BLOCK_SIZE
+    && InitialSize <= MAX_UINTN - sizeof (OC_ARENA_BLOCK) - EFI_PAGE_SIZE) {
+    Arena->InitialSize = ALIGN_VALUE (sizeof (OC_ARENA_BLOCK) + InitialSize, EFI_PAGE_SIZE);
+  }
+}
+
+VOID *
+OcArenaAllocate (
+  IN OUT OC_ARENA  *Arena,
+  IN     UINTN     Size
+  )
+{
+  EFI_STATUS            Status;
+  EFI_PHYSICAL_ADDRESS  Address;
+  OC_ARENA_BLOCK        *Block;
+  UINTN                 BlockSize;
+  UINT8                 *Memory;
+
+  if (Size == 0 || Size > MAX_UINTN - sizeof (OC_ARENA_BLOCK) - EFI_PAGE_SIZE) {
+    return NULL;
+  }
+
+  Size  = ALIGN_VALUE (Size, OC_ARENA_ALIGNMENT);
+  Block = Arena->Blocks;
+
+  if (Block == NULL || Block->Size - Block->Used < Size) {
+    BlockSize = MAX (
+      Block == NULL ? Arena->InitialSize : OC_ARENA_BLOCK_SIZE,
+      ALIGN_VALUE (sizeof (OC_ARENA_BLOCK) + Size, EFI_PAGE_SIZE)
+      );
+    Status = gBS->AllocatePages (
+      AllocateAnyPages,
+      Arena->MemoryType,
+      EFI_SIZE_TO_PAGES (BlockSize),
+      &Address
+      );
+    if (EFI_ERROR (Status)) {
+      return NULL;
+    }
+
+    Block       = (OC_ARENA_BLOCK *)(UINTN) Address;
+    Block->Size = BlockSize;
+    Block->Used = ALIGN_VALUE (sizeof (OC_ARENA_BLOCK), OC_ARENA_ALIGNMENT);
+
+    //
+    // Keep the block with most free space first, so that a large
+    // allocation does not waste the rest of the current block.
+    //
+    if (Arena->Blocks != NULL
+      && Arena->Blocks->Size - Arena->Blocks->Used > Block->Size - Block->Used - Size) {
+      Block->Next         = Arena->Blocks->Next;
+      Arena->Blocks->Next = Block;
+    } else {
+      Block->Next   = Arena->Blocks;
+      Arena->Blocks = Block;
+    }
+
+    ++Arena->BlockCount;
+  }
+
+  Memory       = (UINT8 *) Block + Block->Used;
+  Block->Used += Size;
+  ++Arena->Allocations;
+
+  ZeroMem (Memory, Size);
+  return Memory;
+}
+
+CHAR16 *
+OcArenaAsciiToUnicode (
+  IN OUT OC_ARENA     *Arena,
+  IN     CONST CHAR8  *String
+  )
+{
+  CHAR16  *UnicodeString;
+  UINTN   Length;
+  UINTN   Index;
+
+  Length        = AsciiStrLen (String);
+  UnicodeString = OcArenaAllocate (Arena, (Length + 1) * sizeof (CHAR16));
+  if (UnicodeString == NULL) {
+    return NULL;
+  }
+
+  for (Index = 0; Index < Length; ++Index) {
+    UnicodeString[Index] = (CHAR16) (UINT8) String[Index];
+  }
+
+  return UnicodeString;
+}
+
+VOID
+OcArenaFree (
+  IN OUT OC_ARENA  *Arena
+  )
+{
+  OC_ARENA_BLOCK  *Block;
+  OC_ARENA_BLOCK  *Next;
+
+  DEBUG ((
+    DEBUG_INFO,
+    "OC: Arena released %u allocations in %u blocks\n",
+    Arena->Allocations,
+    Arena->BlockCount
+    ));
+
+  for (Block = Arena->Blocks; Block != NULL; Block = Next) {
+    Next = Block->Next;
+    gBS->FreePages ((EFI_PHYSICAL_ADDRESS)(UINTN) Block, EFI_SIZE_TO_PAGES (Block->Size));
+  }
+
+  OcArenaInit (Arena, Arena->MemoryType, 0);
+}
@@ -0,0 +1,779 @@
+/** @file
+  OpenCore driver.
+
+Copyright (c) 2019, vit9696. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <OpenCore.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+
+/**
+  Terminator for bucket and node chains.
+**/
+#define OC_BATCH_PATCH_END  MAX_UINT32
+
+/**
+  Initial amount of matches to preallocate.
+**/
+#define OC_BATCH_PATCH_MATCH_COUNT  64
+
+typedef struct {
+  UINT32   Patch;
+  UINT32   Next;
+} OC_BATCH_PATCH_NODE;
+
+typedef struct {
+  UINT32   Start;
+  UINT32   Patch;
+  BOOLEAN  Skipped;
+} OC_BATCH_PATCH_MATCH;
+
+typedef struct {
+  UINT32   Anchor;
+  UINT32   ScanSize;
+  UINT32   NextStart;
+  UINT32   SkipLeft;
+  UINT32   Found;
+  BOOLEAN  Done;
+} OC_BATCH_PATCH_STATE;
+
+STATIC
+BOOLEAN
+InternalBatchPatchMatches (
+  IN CONST OC_BATCH_PATCH  *Patch,
+  IN CONST UINT8           *Data
+  )
+{
+  UINT32  Index;
+
+  if (Patch->Mask == NULL) {
+    return CompareMem (Data, Patch->Find, Patch->Size) == 0;
+  }
+
+  for (Index = 0; Index < Patch->Size; ++Index) {
+    if ((Data[Index] & Patch->Mask[Index]) != (Patch->Find[Index] & Patch->Mask[Index])) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+STATIC
+UINT32
+InternalBatchPatchAnchor (
+  IN CONST OC_BATCH_PATCH  *Patch
+  )
+{
+  UINT32  Index;
+  UINT32  Anchor;
+
+  //
+  // Prefer a fully masked byte, which is not a common filler value,
+  // to reduce the amount of candidates we check while scanning.
+  //
+  Anchor = OC_BATCH_PATCH_END;
+
+  for (Index = 0; Index < Patch->Size; ++Index) {
+    if (Patch->Mask != NULL && Patch->Mask[Index] != 0xFF) {
+      continue;
+    }
+
+    if (Patch->Find[Index] != 0x00 && Patch->Find[Index] != 0xFF) {
+      return Index;
+    }
+
+    if (Anchor == OC_BATCH_PATCH_END) {
+      Anchor = Index;
+    }
+  }
+
+  return Anchor != OC_BATCH_PATCH_END ? Anchor : 0;
+}
+
+STATIC
+BOOLEAN
+InternalBatchPatchAnchorMatches (
+  IN CONST OC_BATCH_PATCH  *Patch,
+  IN UINT32                Anchor,
+  IN UINT8                 Value
+  )
+{
+  if (Patch->Mask == NULL) {
+    return Value == Patch->Find[Anchor];
+  }
+
+  return (Value & Patch->Mask[Anchor]) == (Patch->Find[Anchor] & Patch->Mask[Anchor]);
+}
+
+STATIC
+VOID
+InternalBatchPatchWrite (
+  IN     CONST OC_BATCH_PATCH  *Patch,
+  IN OUT UINT8                 *Data
+  )
+{
+  UINT32  Index;
+
+  if (Patch->ReplaceMask == NULL) {
+    CopyMem (Data, Patch->Replace, Patch->Size);
+    return;
+  }
+
+  for (Index = 0; Index < Patch->Size; ++Index) {
+    Data[Index] = (UINT8) ((Data[Index] & ~Patch->ReplaceMask[Index])
+      | (Patch->Replace[Index] & Patch->ReplaceMask[Index]));
+  }
+}
+
+STATIC
+UINT32
+InternalBatchPatchFindMatch (
+  IN CONST OC_BATCH_PATCH_MATCH  *Matches,
+  IN UINT32                      MatchCount,
+  IN UINT32                      Start
+  )
+{
+  UINT32  Low;
+  UINT32  High;
+  UINT32  Middle;
+
+  Low  = 0;
+  High = MatchCount;
+
+  while (Low < High) {
+    Middle = Low + (High - Low) / 2;
+    if (Matches[Middle].Start == Start) {
+      return Middle;
+    }
+
+    if (Matches[Middle].Start < Start) {
+      Low = Middle + 1;
+    } else {
+      High = Middle;
+    }
+  }
+
+  return OC_BATCH_PATCH_END;
+}
+
+/**
+  Check whether patch occurs at any start within [Start, End).
+  Fully masked anchor bytes are looked up with ScanMem8.
+**/
+STATIC
+BOOLEAN
+InternalBatchPatchOccursIn (
+  IN CONST OC_BATCH_PATCH  *Patch,
+  IN UINT32                Anchor,
+  IN CONST UINT8           *Data,
+  IN UINT32                Start,
+  IN UINT32                End
+  )
+{
+  CONST UINT8  *Walker;
+
+  while (Start < End) {
+    if (Patch->Mask == NULL || Patch->Mask[Anchor] == 0xFF) {
+      Walker = ScanMem8 (&Data[Start + Anchor], End - Start, Patch->Find[Anchor]);
+      if (Walker == NULL) {
+        return FALSE;
+      }
+
+      Start = (UINT32) (Walker - Data) - Anchor;
+    } else if (!InternalBatchPatchAnchorMatches (Patch, Anchor, Data[Start + Anchor])) {
+      ++Start;
+      continue;
+    }
+
+    if (InternalBatchPatchMatches (Patch, &Data[Start])) {
+      return TRUE;
+    }
+
+    ++Start;
+  }
+
+  return FALSE;
+}
+
+/**
+  Check that applying the writes did not create new matches for other patches.
+  Patches applied one after another would see each other writes, so such
+  a match means that the result of the batch would differ.
+**/
+STATIC
+BOOLEAN
+InternalBatchPatchHasChains (
+  IN CONST OC_BATCH_PATCH        *Patches,
+  IN CONST OC_BATCH_PATCH_STATE  *State,
+  IN UINT32                      PatchCount,
+  IN CONST OC_BATCH_PATCH_MATCH  *Matches,
+  IN UINT32                      MatchCount,
+  IN CONST UINT8                 *Data
+  )
+{
+  UINT32  MatchIndex;
+  UINT32  Index;
+  UINT32  Start;
+  UINT32  End;
+  UINT32  Found;
+  CONST OC_BATCH_PATCH  *Writer;
+  CONST OC_BATCH_PATCH  *Patch;
+
+  for (MatchIndex = 0; MatchIndex < MatchCount; ++MatchIndex) {
+    if (Matches[MatchIndex].Skipped) {
+      continue;
+    }
+
+    Writer = &Patches[Matches[MatchIndex].Patch];
+
+    for (Index = 0; Index < PatchCount; ++Index) {
+      Patch = &Patches[Index];
+      if (Index == Matches[MatchIndex].Patch || Patch->Size == 0) {
+        continue;
+      }
+
+      if (Matches[MatchIndex].Start >= Patch->Size - 1) {
+        Start = Matches[MatchIndex].Start - (Patch->Size - 1);
+      } else {
+        Start = 0;
+      }
+
+      End = Matches[MatchIndex].Start + Writer->Size;
+
+      for (; Start < End && Start < State[Index].ScanSize; ++Start) {
+        if (Patch->Size > State[Index].ScanSize - Start) {
+          break;
+        }
+
+        if (!InternalBatchPatchMatches (Patch, &Data[Start])) {
+          continue;
+        }
+
+        Found = InternalBatchPatchFindMatch (Matches, MatchCount, Start);
+        if (Found == OC_BATCH_PATCH_END || Matches[Found].Patch != Index) {
+          return TRUE;
+        }
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+EFI_STATUS
+OcApplyBatchPatches (
+  IN OUT OC_BATCH_PATCH       *Patches,
+  IN     UINT32               PatchCount,
+  IN OUT UINT8                *Data,
+  IN     UINT32               DataSize,
+  OUT    OC_BATCH_PATCH_HINT  **Hints      OPTIONAL,
+  OUT    UINT32               *HintCount   OPTIONAL
+  )
+{
+  EFI_STATUS             Status;
+  OC_BATCH_PATCH_STATE   *State;
+  OC_BATCH_PATCH_NODE    *Nodes;
+  OC_BATCH_PATCH_MATCH   *Matches;
+  OC_BATCH_PATCH_MATCH   *NewMatches;
+  OC_BATCH_PATCH_MATCH   Match;
+  OC_BATCH_PATCH         *Patch;
+  UINT8                  *Undo;
+  UINT32                 Buckets[256];
+  UINT32                 NodeCount;
+  UINT32                 MatchCount;
+  UINT32                 MatchCapacity;
+  UINT32                 UndoSize;
+  UINT32                 Active;
+  UINT32                 Index;
+  UINT32                 Value;
+  UINT32                 NodeIndex;
+  UINT32                 Offset;
+  UINT32                 Start;
+  UINT32                 MaxEnd;
+  UINT32                 MaxEndPatch;
+  UINT32                 WriteEnd;
+  UINT32                 WriteEndPatch;
+  UINT32                 MaxSize;
+
+  if (Hints != NULL) {
+    ASSERT (HintCount != NULL);
+    *Hints     = NULL;
+    *HintCount = 0;
+  }
+
+  if (PatchCount == 0) {
+    return EFI_SUCCESS;
+  }
+
+  State = AllocateZeroPool (PatchCount * sizeof (*State));
+  if (State == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Compile the patches into first byte buckets. Patches with a partially masked
+  // anchor byte go to every bucket they may match. Buckets keep patch order.
+  //
+  NodeCount = 0;
+  Active    = 0;
+  MaxSize   = 1;
+
+  for (Index = 0; Index < PatchCount; ++Index) {
+    Patch = &Patches[Index];
+    Patch->ReplaceCount = 0;
+
+    State[Index].ScanSize = DataSize;
+    if (Patch->Limit > 0 && Patch->Limit < DataSize) {
+      State[Index].ScanSize = Patch->Limit;
+    }
+
+    if (Patch->Size == 0 || Patch->Size > State[Index].ScanSize) {
+      State[Index].Done = TRUE;
+      continue;
+    }
+
+    if (Patch->Size > MaxSize) {
+      MaxSize = Patch->Size;
+    }
+
+    State[Index].Anchor   = InternalBatchPatchAnchor (Patch);
+    State[Index].SkipLeft = Patch->Skip;
+    ++Active;
+
+    if (Patch->Mask == NULL || Patch->Mask[State[Index].Anchor] == 0xFF) {
+      ++NodeCount;
+    } else {
+      for (Value = 0; Value < ARRAY_SIZE (Buckets); ++Value) {
+        if (InternalBatchPatchAnchorMatches (Patch, State[Index].Anchor, (UINT8) Value)) {
+          ++NodeCount;
+        }
+      }
+    }
+  }
+
+  if (Active == 0) {
+    FreePool (State);
+    return EFI_SUCCESS;
+  }
+
+  Nodes = AllocatePool (NodeCount * sizeof (*Nodes));
+  if (Nodes == NULL) {
+    FreePool (State);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  SetMem (Buckets, sizeof (Buckets), 0xFF);
+
+  NodeIndex = 0;
+  Index     = PatchCount;
+  while (Index > 0) {
+    --Index;
+    if (State[Index].Done) {
+      continue;
+    }
+
+    for (Value = 0; Value < ARRAY_SIZE (Buckets); ++Value) {
+      if (InternalBatchPatchAnchorMatches (&Patches[Index], State[Index].Anchor, (UINT8) Value)) {
+        Nodes[NodeIndex].Patch = Index;
+        Nodes[NodeIndex].Next  = Buckets[Value];
+        Buckets[Value]         = NodeIndex;
+        ++NodeIndex;
+      }
+    }
+  }
+
+  MatchCount    = 0;
+  MatchCapacity = OC_BATCH_PATCH_MATCH_COUNT;
+  Matches       = AllocatePool (MatchCapacity * sizeof (*Matches));
+  if (Matches == NULL) {
+    FreePool (Nodes);
+    FreePool (State);
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  //
+  // Perform a single read-only pass, recording matches of every patch.
+  // Per-patch semantics follow ApplyPatch: occurrences do not overlap,
+  // Skip occurrences are ignored, and at most Count are replaced.
+  //
+  Status = EFI_SUCCESS;
+
+  for (Offset = 0; Offset < DataSize && Active > 0; ++Offset) {
+    for (NodeIndex = Buckets[Data[Offset]]; NodeIndex != OC_BATCH_PATCH_END; NodeIndex = Nodes[NodeIndex].Next) {
+      Index = Nodes[NodeIndex].Patch;
+      Patch = &Patches[Index];
+
+      if (State[Index].Done || Offset < State[Index].Anchor) {
+        continue;
+      }
+
+      Start = Offset - State[Index].Anchor;
+      if (Start < State[Index].NextStart
+        || Start >= State[Index].ScanSize
+        || Patch->Size > State[Index].ScanSize - Start
+        || !InternalBatchPatchMatches (Patch, &Data[Start])) {
+        continue;
+      }
+
+      if (MatchCount == MatchCapacity) {
+        NewMatches = ReallocatePool (
+          MatchCapacity * sizeof (*Matches),
+          2 * MatchCapacity * sizeof (*Matches),
+          Matches
+          );
+        if (NewMatches == NULL) {
+          Status = EFI_OUT_OF_RESOURCES;
+          break;
+        }
+        Matches        = NewMatches;
+        MatchCapacity *= 2;
+      }
+
+      Matches[MatchCount].Start   = Start;
+      Matches[MatchCount].Patch   = Index;
+      Matches[MatchCount].Skipped = State[Index].SkipLeft > 0;
+      ++MatchCount;
+
+      State[Index].NextStart = Start + Patch->Size;
+
+      if (State[Index].SkipLeft > 0) {
+        --State[Index].SkipLeft;
+      } else {
+        ++State[Index].Found;
+        if (Patch->Count > 0 && State[Index].Found == Patch->Count) {
+          State[Index].Done = TRUE;
+          --Active;
+        }
+      }
+    }
+
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+  }
+
+  FreePool (Nodes);
+
+  if (EFI_ERROR (Status)) {
+    FreePool (Matches);
+    FreePool (State);
+    return Status;
+  }
+
+  //
+  // Order matches by start. Anchors are shorter than patches,
+  // so the list is almost sorted and insertion sort is cheap.
+  //
+  for (Index = 1; Index < MatchCount; ++Index) {
+    Match     = Matches[Index];
+    NodeIndex = Index;
+    while (NodeIndex > 0 && Matches[NodeIndex - 1].Start > Match.Start) {
+      Matches[NodeIndex] = Matches[NodeIndex - 1];
+      --NodeIndex;
+    }
+    Matches[NodeIndex] = Match;
+  }
+
+  //
+  // Overlapping occurrences of different patches depend on the order
+  // of application, leave these to the caller. Writes of different patches
+  // must also be far enough apart for the chain check to look at each of
+  // them separately.
+  //
+  MaxEnd        = 0;
+  MaxEndPatch   = OC_BATCH_PATCH_END;
+  WriteEnd      = 0;
+  WriteEndPatch = OC_BATCH_PATCH_END;
+  UndoSize      = 0;
+
+  for (Index = 0; Index < MatchCount; ++Index) {
+    Patch = &Patches[Matches[Index].Patch];
+
+    if (Matches[Index].Start < MaxEnd && Matches[Index].Patch != MaxEndPatch) {
+      Status = EFI_ABORTED;
+      break;
+    }
+
+    Offset = Matches[Index].Start + Patch->Size;
+    if (Offset > MaxEnd) {
+      MaxEnd      = Offset;
+      MaxEndPatch = Matches[Index].Patch;
+    }
+
+    if (Matches[Index].Skipped) {
+      continue;
+    }
+
+    if (WriteEndPatch != OC_BATCH_PATCH_END
+      && Matches[Index].Patch != WriteEndPatch
+      && Matches[Index].Start - WriteEnd < MaxSize - 1) {
+      Status = EFI_ABORTED;
+      break;
+    }
+
+    if (Offset > WriteEnd) {
+      WriteEnd      = Offset;
+      WriteEndPatch = Matches[Index].Patch;
+    }
+
+    UndoSize += Patch->Size;
+  }
+
+  Undo = NULL;
+  if (!EFI_ERROR (Status) && UndoSize > 0) {
+    Undo = AllocatePool (UndoSize);
+    if (Undo == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+    }
+  }
+
+  if (!EFI_ERROR (Status) && Undo != NULL) {
+    Offset = 0;
+    for (Index = 0; Index < MatchCount; ++Index) {
+      if (!Matches[Index].Skipped) {
+        Patch = &Patches[Matches[Index].Patch];
+        CopyMem (&Undo[Offset], &Data[Matches[Index].Start], Patch->Size);
+        InternalBatchPatchWrite (Patch, &Data[Matches[Index].Start]);
+        Offset += Patch->Size;
+      }
+    }
+
+    if (InternalBatchPatchHasChains (Patches, State, PatchCount, Matches, MatchCount, Data)) {
+      Offset = 0;
+      for (Index = 0; Index < MatchCount; ++Index) {
+        if (!Matches[Index].Skipped) {
+          Patch = &Patches[Matches[Index].Patch];
+          CopyMem (&Data[Matches[Index].Start], &Undo[Offset], Patch->Size);
+          Offset += Patch->Size;
+        }
+      }
+
+      Status = EFI_ABORTED;
+    }
+
+    FreePool (Undo);
+  }
+
+  if (!EFI_ERROR (Status) && Hints != NULL && UndoSize > 0) {
+    Offset = 0;
+    for (Index = 0; Index < PatchCount; ++Index) {
+      Offset += State[Index].Found;
+    }
+
+    *Hints = AllocatePool (Offset * sizeof (**Hints));
+    if (*Hints != NULL) {
+      for (Index = 0; Index < MatchCount; ++Index) {
+        if (!Matches[Index].Skipped) {
+          (*Hints)[*HintCount].Patch  = Matches[Index].Patch;
+          (*Hints)[*HintCount].Offset = Matches[Index].Start;
+          ++(*HintCount);
+        }
+      }
+    }
+  }
+
+  if (!EFI_ERROR (Status)) {
+    for (Index = 0; Index < PatchCount; ++Index) {
+      Patches[Index].ReplaceCount = State[Index].Found;
+    }
+  }
+
+  FreePool (Matches);
+  FreePool (State);
+
+  return Status;
+}
+
+EFI_STATUS
+OcApplyBatchPatchHints (
+  IN OUT OC_BATCH_PATCH             *Patches,
+  IN     UINT32                     PatchCount,
+  IN OUT UINT8                      *Data,
+  IN     UINT32                     DataSize,
+  IN     CONST OC_BATCH_PATCH_HINT  *Hints,
+  IN     UINT32                     HintCount
+  )
+{
+  EFI_STATUS            Status;
+  OC_BATCH_PATCH_STATE  *State;
+  OC_BATCH_PATCH_MATCH  *Matches;
+  OC_BATCH_PATCH        *Patch;
+  UINT8                 *Undo;
+  UINT32                UndoSize;
+  UINT32                Index;
+  UINT32                End;
+  UINT32                Offset;
+
+  for (Index = 0; Index < PatchCount; ++Index) {
+    Patches[Index].ReplaceCount = 0;
+  }
+
+  if (PatchCount == 0) {
+    return HintCount == 0 ? EFI_SUCCESS : EFI_NOT_FOUND;
+  }
+
+  State = AllocateZeroPool (PatchCount * sizeof (*State));
+  if (State == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = EFI_SUCCESS;
+
+  for (Index = 0; Index < PatchCount; ++Index) {
+    Patch = &Patches[Index];
+
+    //
+    // Skipped occurrences are not recorded, so they cannot be verified.
+    //
+    if (Patch->Skip > 0) {
+      Status = EFI_NOT_FOUND;
+      break;
+    }
+
+    State[Index].ScanSize = DataSize;
+    if (Patch->Limit > 0 && Patch->Limit < DataSize) {
+      State[Index].ScanSize = Patch->Limit;
+    }
+
+    if (Patch->Size > 0) {
+      State[Index].Anchor = InternalBatchPatchAnchor (Patch);
+    }
+  }
+
+  //
+  // Occurrences come sorted and never overlap, anything else means
+  // the hints do not belong to these patches.
+  //
+  End      = 0;
+  UndoSize = 0;
+
+  for (Index = 0; Index < HintCount && !EFI_ERROR (Status); ++Index) {
+    if (Hints[Index].Patch >= PatchCount || Hints[Index].Offset < End) {
+      Status = EFI_NOT_FOUND;
+      break;
+    }
+
+    Patch = &Patches[Hints[Index].Patch];
+
+    if (Patch->Size == 0
+      || Hints[Index].Offset >= State[Hints[Index].Patch].ScanSize
+      || Patch->Size > State[Hints[Index].Patch].ScanSize - Hints[Index].Offset
+      || (Patch->Count > 0 && Patch->ReplaceCount == Patch->Count)
+      || !InternalBatchPatchMatches (Patch, &Data[Hints[Index].Offset])) {
+      Status = EFI_NOT_FOUND;
+      break;
+    }
+
+    //
+    // Occurrences must also be the first ones ApplyPatch would find,
+    // so the patch may not occur before the hint since its previous one.
+    //
+    if (InternalBatchPatchOccursIn (
+      Patch,
+      State[Hints[Index].Patch].Anchor,
+      Data,
+      State[Hints[Index].Patch].NextStart,
+      Hints[Index].Offset
+      )) {
+      Status = EFI_NOT_FOUND;
+      break;
+    }
+
+    State[Hints[Index].Patch].NextStart = Hints[Index].Offset + Patch->Size;
+    ++Patch->ReplaceCount;
+    End       = Hints[Index].Offset + Patch->Size;
+    UndoSize += Patch->Size;
+  }
+
+  //
+  // Patches, which did not reach their Count, may not occur after their
+  // last hint either.
+  //
+  for (Index = 0; Index < PatchCount && !EFI_ERROR (Status); ++Index) {
+    Patch = &Patches[Index];
+    if (Patch->Size == 0
+      || Patch->Size > State[Index].ScanSize
+      || (Patch->Count > 0 && Patch->ReplaceCount == Patch->Count)) {
+      continue;
+    }
+
+    if (InternalBatchPatchOccursIn (
+      Patch,
+      State[Index].Anchor,
+      Data,
+      State[Index].NextStart,
+      State[Index].ScanSize - Patch->Size + 1
+      )) {
+      Status = EFI_NOT_FOUND;
+    }
+  }
+
+  Matches = NULL;
+  Undo    = NULL;
+  if (!EFI_ERROR (Status) && HintCount > 0) {
+    Matches = AllocatePool (HintCount * sizeof (*Matches));
+    Undo    = AllocatePool (UndoSize);
+    if (Matches == NULL || Undo == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+    }
+  }
+
+  //
+  // Masked out bytes may differ from the recorded kernel, so writes
+  // are checked for creating new matches just like in OcApplyBatchPatches.
+  //
+  if (!EFI_ERROR (Status) && HintCount > 0) {
+    Offset = 0;
+    for (Index = 0; Index < HintCount; ++Index) {
+      Patch = &Patches[Hints[Index].Patch];
+      Matches[Index].Start   = Hints[Index].Offset;
+      Matches[Index].Patch   = Hints[Index].Patch;
+      Matches[Index].Skipped = FALSE;
+      CopyMem (&Undo[Offset], &Data[Hints[Index].Offset], Patch->Size);
+      InternalBatchPatchWrite (Patch, &Data[Hints[Index].Offset]);
+      Offset += Patch->Size;
+    }
+
+    if (InternalBatchPatchHasChains (Patches, State, PatchCount, Matches, HintCount, Data)) {
+      Offset = 0;
+      for (Index = 0; Index < HintCount; ++Index) {
+        Patch = &Patches[Hints[Index].Patch];
+        CopyMem (&Data[Hints[Index].Offset], &Undo[Offset], Patch->Size);
+        Offset += Patch->Size;
+      }
+
+      Status = EFI_ABORTED;
+    }
+  }
+
+  if (Matches != NULL) {
+    FreePool (Matches);
+  }
+
+  if (Undo != NULL) {
+    FreePool (Undo);
+  }
+
+  FreePool (State);
+
+  if (EFI_ERROR (Status)) {
+    for (Index = 0; Index < PatchCount; ++Index) {
+      Patches[Index].ReplaceCount = 0;
+    }
+  }
+
+  return Status;
+}
@@ -15,6 +15,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <OpenCore.h>
 
 #include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
 #include <Library/DebugLib.h>
 #include <Library/DevicePathLib.h>
 #include <Library/MemoryAllocationLib.h>
@@ -27,137 +28,271 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Protocol/DevicePath.h>
 #include <Protocol/DevicePathPropertyDatabase.h>
 
-VOID
-OcLoadDevPropsSupport (
-  IN OC_GLOBAL_CONFIG    *Config
+/**
+  Find or add interned device for device path text.
+
+  @param[in,out] Arena      Arena allocator.
+  @param[in,out] Table      Compiled device properties.
+  @param[in]     AsciiPath  Device path text.
+
+  @retval interned device or NULL when device path is invalid.
+**/
+STATIC
+CONST OC_DEVPROPS_DEVICE *
+OcInternDevPropsDevice (
+  IN OUT OC_ARENA           *Arena,
+  IN OUT OC_DEVPROPS_TABLE  *Table,
+  IN     CONST CHAR8        *AsciiPath
   )
 {
-  EFI_STATUS                                  Status;
-  UINT32                                      DeviceIndex;
-  UINT32                                      PropertyIndex;
-  EFI_DEVICE_PATH_PROPERTY_DATABASE_PROTOCOL  *PropertyDatabase;
-  OC_ASSOC                                    *PropertyMap;
-  CHAR8                                       *AsciiDevicePath;
-  CHAR16                                      *UnicodeDevicePath;
-  CHAR8                                       *AsciiProperty;
-  CHAR16                                      *UnicodeProperty;
-  EFI_DEVICE_PATH_PROTOCOL                    *DevicePath;
-  UINTN                                       OriginalSize;
+  UINT32                    Index;
+  OC_DEVPROPS_DEVICE        *Device;
+  CHAR16                    *UnicodePath;
+  EFI_DEVICE_PATH_PROTOCOL  *DevicePath;
+  UINTN                     DevicePathSize;
 
-  PropertyDatabase = OcDevicePathPropertyInstallProtocol (FALSE);
-  if (PropertyDatabase == NULL) {
-    DEBUG ((DEBUG_ERROR, "OC: Device property database protocol is missing\n"));
-    return;
+  for (Index = 0; Index < Table->DeviceCount; ++Index) {
+    if (AsciiStrCmp (Table->Devices[Index].AsciiPath, AsciiPath) == 0) {
+      return Table->Devices[Index].DevicePath != NULL ? &Table->Devices[Index] : NULL;
+    }
   }
 
-  for (DeviceIndex = 0; DeviceIndex < Config->DeviceProperties.Block.Count; ++DeviceIndex) {
-    AsciiDevicePath   = OC_BLOB_GET (Config->DeviceProperties.Block.Keys[DeviceIndex]);
+  Device            = &Table->Devices[Table->DeviceCount++];
+  Device->AsciiPath = AsciiPath;
 
-    UnicodeDevicePath = AsciiStrCopyToUnicode (AsciiDevicePath, 0);
-    DevicePath        = NULL;
+  UnicodePath = OcArenaAsciiToUnicode (Arena, AsciiPath);
+  DevicePath  = NULL;
 
-    if (UnicodeDevicePath != NULL) {
-      DevicePath = ConvertTextToDevicePath (UnicodeDevicePath);
-      FreePool (UnicodeDevicePath);
-    }
+  if (UnicodePath != NULL) {
+    DevicePath = ConvertTextToDevicePath (UnicodePath);
+  }
 
-    if (DevicePath == NULL) {
-      DEBUG ((DEBUG_WARN, "OC: Failed to parse %a device path\n", AsciiDevicePath));
-      continue;
+  if (DevicePath != NULL) {
+    DevicePathSize     = GetDevicePathSize (DevicePath);
+    Device->DevicePath = OcArenaAllocate (Arena, DevicePathSize);
+    if (Device->DevicePath != NULL) {
+      CopyMem (Device->DevicePath, DevicePath, DevicePathSize);
     }
+    FreePool (DevicePath);
+  }
 
-    for (PropertyIndex = 0; PropertyIndex < Config->DeviceProperties.Block.Values[DeviceIndex]->Count; ++PropertyIndex) {
-      AsciiProperty       = OC_BLOB_GET (Config->DeviceProperties.Block.Values[DeviceIndex]->Values[PropertyIndex]);
-      UnicodeProperty = AsciiStrCopyToUnicode (AsciiProperty, 0);
+  if (Device->DevicePath == NULL) {
+    DEBUG ((DEBUG_WARN, "OC: Failed to parse %a device path\n", AsciiPath));
+    return NULL;
+  }
 
-      if (UnicodeProperty == NULL) {
-        DEBUG ((DEBUG_WARN, "OC: Failed to convert %a property\n", AsciiProperty));
-        continue;
-      }
+  return Device;
+}
 
-      Status = PropertyDatabase->RemoveProperty (
-        PropertyDatabase,
-        DevicePath,
-        UnicodeProperty
-        );
+/**
+  Find or add interned Unicode property name.
 
-      DEBUG ((
-        EFI_ERROR (Status) && Status != EFI_NOT_FOUND ? DEBUG_WARN : DEBUG_INFO,
-        "OC: Removing devprop %a:%a - %r\n",
-        AsciiDevicePath,
-        AsciiProperty,
-        Status
-        ));
+  @param[in,out] Arena      Arena allocator.
+  @param[in]     Table      Compiled device properties.
+  @param[in]     AsciiName  Property name.
 
-      FreePool (UnicodeProperty);
+  @retval interned property name or NULL.
+**/
+STATIC
+CONST CHAR16 *
+OcInternDevPropsName (
+  IN OUT OC_ARENA                 *Arena,
+  IN     CONST OC_DEVPROPS_TABLE  *Table,
+  IN     CONST CHAR8              *AsciiName
+  )
+{
+  UINT32  Index;
+
+  for (Index = 0; Index < Table->BlockCount; ++Index) {
+    if (AsciiStrCmp (Table->Block[Index].AsciiName, AsciiName) == 0) {
+      return Table->Block[Index].Name;
     }
+  }
 
-    FreePool (DevicePath);
+  for (Index = 0; Index < Table->AddCount; ++Index) {
+    if (AsciiStrCmp (Table->Add[Index].AsciiName, AsciiName) == 0) {
+      return Table->Add[Index].Name;
+    }
   }
 
+  return OcArenaAsciiToUnicode (Arena, AsciiName);
+}
+
+VOID
+OcCompileDevProps (
+  IN     OC_GLOBAL_CONFIG   *Config,
+  IN OUT OC_ARENA           *Arena,
+  OUT    OC_DEVPROPS_TABLE  *Table
+  )
+{
+  UINT32                    DeviceIndex;
+  UINT32                    PropertyIndex;
+  UINT32                    BlockCount;
+  UINT32                    AddCount;
+  OC_ASSOC                  *PropertyMap;
+  CONST OC_DEVPROPS_DEVICE  *Device;
+  OC_DEVPROPS_PROPERTY      *Property;
+
+  ZeroMem (Table, sizeof (*Table));
+
+  BlockCount = 0;
+  for (DeviceIndex = 0; DeviceIndex < Config->DeviceProperties.Block.Count; ++DeviceIndex) {
+    BlockCount += Config->DeviceProperties.Block.Values[DeviceIndex]->Count;
+  }
+
+  AddCount = 0;
   for (DeviceIndex = 0; DeviceIndex < Config->DeviceProperties.Add.Count; ++DeviceIndex) {
-    PropertyMap       = Config->DeviceProperties.Add.Values[DeviceIndex];
-    AsciiDevicePath   = OC_BLOB_GET (Config->DeviceProperties.Add.Keys[DeviceIndex]);
-    UnicodeDevicePath = AsciiStrCopyToUnicode (AsciiDevicePath, 0);
-    DevicePath        = NULL;
-
-    if (UnicodeDevicePath != NULL) {
-      DevicePath = ConvertTextToDevicePath (UnicodeDevicePath);
-      FreePool (UnicodeDevicePath);
+    AddCount += Config->DeviceProperties.Add.Values[DeviceIndex]->Count;
+  }
+
+  if (BlockCount + AddCount == 0) {
+    return;
+  }
+
+  Table->Devices = OcArenaAllocate (
+    Arena,
+    (Config->DeviceProperties.Block.Count + Config->DeviceProperties.Add.Count) * sizeof (*Table->Devices)
+    );
+  Table->Block = OcArenaAllocate (Arena, MAX (BlockCount, 1) * sizeof (*Table->Block));
+  Table->Add   = OcArenaAllocate (Arena, MAX (AddCount, 1) * sizeof (*Table->Add));
+  if (Table->Devices == NULL || Table->Block == NULL || Table->Add == NULL) {
+    DEBUG ((DEBUG_ERROR, "OC: Failed to allocate device properties\n"));
+    ZeroMem (Table, sizeof (*Table));
+    return;
+  }
+
+  for (DeviceIndex = 0; DeviceIndex < Config->DeviceProperties.Block.Count; ++DeviceIndex) {
+    Device = OcInternDevPropsDevice (
+      Arena,
+      Table,
+      OC_BLOB_GET (Config->DeviceProperties.Block.Keys[DeviceIndex])
+      );
+    if (Device == NULL) {
+      continue;
     }
 
-    if (DevicePath == NULL) {
-      DEBUG ((DEBUG_WARN, "OC: Failed to parse %a device path\n", AsciiDevicePath));
+    for (PropertyIndex = 0; PropertyIndex < Config->DeviceProperties.Block.Values[DeviceIndex]->Count; ++PropertyIndex) {
+      Property            = &Table->Block[Table->BlockCount];
+      Property->Device    = Device;
+      Property->AsciiName = OC_BLOB_GET (Config->DeviceProperties.Block.Values[DeviceIndex]->Values[PropertyIndex]);
+      Property->Name      = OcInternDevPropsName (Arena, Table, Property->AsciiName);
+
+      if (Property->Name == NULL) {
+        DEBUG ((DEBUG_WARN, "OC: Failed to convert %a property\n", Property->AsciiName));
+        continue;
+      }
+
+      ++Table->BlockCount;
+    }
+  }
+
+  for (DeviceIndex = 0; DeviceIndex < Config->DeviceProperties.Add.Count; ++DeviceIndex) {
+    PropertyMap = Config->DeviceProperties.Add.Values[DeviceIndex];
+    Device      = OcInternDevPropsDevice (
+      Arena,
+      Table,
+      OC_BLOB_GET (Config->DeviceProperties.Add.Keys[DeviceIndex])
+      );
+    if (Device == NULL) {
       continue;
     }
 
     for (PropertyIndex = 0; PropertyIndex < PropertyMap->Count; ++PropertyIndex) {
-      AsciiProperty   = OC_BLOB_GET (PropertyMap->Keys[PropertyIndex]);
-      UnicodeProperty = AsciiStrCopyToUnicode (AsciiProperty, 0);
+      Property            = &Table->Add[Table->AddCount];
+      Property->Device    = Device;
+      Property->AsciiName = OC_BLOB_GET (PropertyMap->Keys[PropertyIndex]);
+      Property->Name      = OcInternDevPropsName (Arena, Table, Property->AsciiName);
+      Property->Value     = OC_BLOB_GET (PropertyMap->Values[PropertyIndex]);
+      Property->ValueSize = PropertyMap->Values[PropertyIndex]->Size;
 
-      if (UnicodeProperty == NULL) {
-        DEBUG ((DEBUG_WARN, "OC: Failed to convert %a property\n", AsciiProperty));
+      if (Property->Name == NULL) {
+        DEBUG ((DEBUG_WARN, "OC: Failed to convert %a property\n", Property->AsciiName));
         continue;
       }
 
-      OriginalSize = 0;
-      Status = PropertyDatabase->GetProperty (
+      ++Table->AddCount;
+    }
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "OC: Compiled %u devices for %u removed and %u added properties\n",
+    Table->DeviceCount,
+    Table->BlockCount,
+    Table->AddCount
+    ));
+}
+
+VOID
+OcLoadDevPropsSupport (
+  IN CONST OC_DEVPROPS_TABLE  *Table
+  )
+{
+  EFI_STATUS                                  Status;
+  UINT32                                      Index;
+  EFI_DEVICE_PATH_PROPERTY_DATABASE_PROTOCOL  *PropertyDatabase;
+  CONST OC_DEVPROPS_PROPERTY                  *Property;
+  UINTN                                       OriginalSize;
+
+  PropertyDatabase = OcDevicePathPropertyInstallProtocol (FALSE);
+  if (PropertyDatabase == NULL) {
+    DEBUG ((DEBUG_ERROR, "OC: Device property database protocol is missing\n"));
+    return;
+  }
+
+  for (Index = 0; Index < Table->BlockCount; ++Index) {
+    Property = &Table->Block[Index];
+
+    Status = PropertyDatabase->RemoveProperty (
+      PropertyDatabase,
+      Property->Device->DevicePath,
+      Property->Name
+      );
+
+    DEBUG ((
+      EFI_ERROR (Status) && Status != EFI_NOT_FOUND ? DEBUG_WARN : DEBUG_INFO,
+      "OC: Removing devprop %a:%a - %r\n",
+      Property->Device->AsciiPath,
+      Property->AsciiName,
+      Status
+      ));
+  }
+
+  for (Index = 0; Index < Table->AddCount; ++Index) {
+    Property = &Table->Add[Index];
+
+    OriginalSize = 0;
+    Status = PropertyDatabase->GetProperty (
+      PropertyDatabase,
+      Property->Device->DevicePath,
+      Property->Name,
+      NULL,
+      &OriginalSize
+      );
+
+    if (Status != EFI_BUFFER_TOO_SMALL) {
+      Status = PropertyDatabase->SetProperty (
         PropertyDatabase,
-        DevicePath,
-        UnicodeProperty,
-        NULL,
-        &OriginalSize
+        Property->Device->DevicePath,
+        Property->Name,
+        Property->Value,
+        Property->ValueSize
         );
 
-      if (Status != EFI_BUFFER_TOO_SMALL) {
-        Status = PropertyDatabase->SetProperty (
-          PropertyDatabase,
-          DevicePath,
-          UnicodeProperty,
-          OC_BLOB_GET (PropertyMap->Values[PropertyIndex]),
-          PropertyMap->Values[PropertyIndex]->Size
-          );
-
-        DEBUG ((
-          EFI_ERROR (Status) ? DEBUG_WARN : DEBUG_INFO,
-          "OC: Setting devprop %a:%a - %r\n",
-          AsciiDevicePath,
-          AsciiProperty,
-          Status
-          ));
-      } else {
-        DEBUG ((
-          DEBUG_INFO,
-          "OC: Setting devprop %a:%a - ignored, exists\n",
-          AsciiDevicePath,
-          AsciiProperty,
-          Status
-          ));
-      }
-
-      FreePool (UnicodeProperty);
+      DEBUG ((
+        EFI_ERROR (Status) ? DEBUG_WARN : DEBUG_INFO,
+        "OC: Setting devprop %a:%a - %r\n",
+        Property->Device->AsciiPath,
+        Property->AsciiName,
+        Status
+        ));
+    } else {
+      DEBUG ((
+        DEBUG_INFO,
+        "OC: Setting devprop %a:%a - ignored, exists\n",
+        Property->Device->AsciiPath,
+        Property->AsciiName
+        ));
     }
-
-    FreePool (DevicePath);
   }
 }
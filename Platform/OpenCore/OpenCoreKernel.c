@@ -14,19 +14,184 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 
 #include <OpenCore.h>
 
+#include <IndustryStandard/AppleCompressedBinaryImage.h>
+
 #include <Library/BaseLib.h>
 #include <Library/DebugLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/OcAppleKernelLib.h>
+#include <Library/OcCompressionLib.h>
+#include <Library/OcMachoLib.h>
 #include <Library/OcMiscLib.h>
 #include <Library/OcStringLib.h>
 #include <Library/OcVirtualFsLib.h>
 #include <Library/PrintLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 
+/**
+  Reserve kext space from parsed plist and Mach-O sizes instead of
+  the conservative library estimate. Reserved versus used space is
+  reported after injection to validate this mode.
+**/
+#ifndef OC_KERNEL_EXACT_RESERVE
+#define OC_KERNEL_EXACT_RESERVE  0
+#endif
+
+/**
+  Space for prelink keys added to each injected kext plist.
+**/
+#define OC_KERNEL_KEXT_INFO_EXTRA_SIZE  1024
+
 STATIC OC_STORAGE_CONTEXT  *mOcStorage;
 STATIC OC_GLOBAL_CONFIG    *mOcConfiguration;
 STATIC OC_CPU_INFO         *mOcCpuInfo;
+STATIC BOOLEAN             mOcKernelCacheEnabled;
+
+//
+// Handles opened through the kernel hook, wrapped for further filtering
+// and returned as is.
+//
+STATIC UINT32              mOcKernelWrappedHandles;
+STATIC UINT32              mOcKernelRawHandles;
+
+///
+/// Directory name which may lead to a kernel.
+///
+typedef struct {
+  CONST CHAR16  *Name;
+  UINTN         Length;
+} OC_KERNEL_PATH_NAME;
+
+#define OC_KERNEL_PATH_NAME_ENTRY(Name) { (Name), L_STR_LEN (Name) }
+
+STATIC CONST OC_KERNEL_PATH_NAME mOcKernelPathNames[] = {
+  OC_KERNEL_PATH_NAME_ENTRY (L"System"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"Library"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"Kernels"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"Caches"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"com.apple.kext.caches"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"Startup"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"PrelinkedKernels"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"com.apple.boot.R"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"com.apple.boot.P"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"com.apple.boot.S"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"com.apple.recovery.boot"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"com.apple.installer"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"macOS Install Data"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"OS X Install Data"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"Mac OS X Install Data"),
+  OC_KERNEL_PATH_NAME_ENTRY (L".IABootFiles"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"Locked Files"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"Boot Files"),
+  OC_KERNEL_PATH_NAME_ENTRY (L"."),
+  OC_KERNEL_PATH_NAME_ENTRY (L"..")
+};
+
+///
+/// Precompiled kernel configuration entry.
+///
+typedef struct {
+  ///
+  /// Interned identifier index, MAX_UINT32 when not applicable
+  /// or when the configuration could not be compiled.
+  ///
+  UINT32                 Identifier;
+  ///
+  /// Target identifier, NULL when not applicable.
+  ///
+  CONST CHAR8            *Target;
+  ///
+  /// Parsed minimal kernel version.
+  ///
+  UINT32                 MinKernel;
+  ///
+  /// Parsed maximal kernel version.
+  ///
+  UINT32                 MaxKernel;
+} OC_KERNEL_ENTRY_INFO;
+
+///
+/// Precompiled kernel patch.
+///
+typedef struct {
+  ///
+  /// Common entry information.
+  ///
+  OC_KERNEL_ENTRY_INFO   Entry;
+  ///
+  /// Patch is enabled and valid.
+  ///
+  BOOLEAN                Enabled;
+  ///
+  /// Patch targets the kernel itself.
+  ///
+  BOOLEAN                IsKernel;
+  ///
+  /// Prepared patch descriptor.
+  ///
+  PATCHER_GENERIC_PATCH  Patch;
+} OC_KERNEL_PATCH_INFO;
+
+///
+/// Kext patcher context resolved once per prelinked kernel.
+///
+typedef struct {
+  ///
+  /// Context lookup was performed.
+  ///
+  BOOLEAN                Resolved;
+  ///
+  /// Context lookup status.
+  ///
+  EFI_STATUS             Status;
+  ///
+  /// Patcher context for the kext.
+  ///
+  PATCHER_CONTEXT        Patcher;
+} OC_KERNEL_KEXT_PATCHER;
+
+///
+/// Kernel patch offset hints.
+///
+typedef struct {
+  ///
+  /// Kernel LC_UUID the hints are keyed by.
+  ///
+  MACH_UUID_COMMAND      *Uuid;
+  ///
+  /// Hints from the previous boot.
+  ///
+  VOID                   *Loaded;
+  UINT32                 LoadedSize;
+  ///
+  /// Hints for the current boot.
+  ///
+  VOID                   *Updated;
+  UINT32                 UpdatedSize;
+  ///
+  /// Updated hints differ from loaded hints.
+  ///
+  BOOLEAN                Changed;
+  ///
+  /// Amount of batches applied from hints.
+  ///
+  UINT32                 Hits;
+} OC_KERNEL_PATCH_HINTS;
+
+/**
+  Maximum decompressed size of a kext file stored compressed.
+**/
+#define OC_KERNEL_KEXT_MAX_DECOMPRESSED_SIZE  BASE_64MB
+
+//
+// Kernel configuration compiled once in OcLoadKernelSupport, so that kernel
+// hooks do not need to parse strings every time.
+//
+STATIC OC_KERNEL_PATCH_INFO  *mOcKernelPatches;
+STATIC OC_KERNEL_ENTRY_INFO  *mOcKernelBlocks;
+STATIC OC_KERNEL_ENTRY_INFO  *mOcKernelAdds;
+STATIC CONST CHAR8           **mOcKernelIdentifiers;
+STATIC UINT32                mOcKernelIdentifierCount;
 
 STATIC
 UINT32
@@ -119,6 +284,118 @@ OcMatchDarwinVersion (
   return TRUE;
 }
 
+/**
+  Find the first occurrence of String in Data.
+
+  Candidates for the first character are located a machine word at a time,
+  which is considerably faster than the byte-by-byte comparison FindPattern
+  performs, and is portable across all supported toolchains.
+**/
+STATIC
+INT32
+OcKernelFindString (
+  IN CONST UINT8  *Data,
+  IN UINT32       DataSize,
+  IN CONST CHAR8  *String,
+  IN UINT32       StringSize
+  )
+{
+  UINT32  Offset;
+  UINT32  Index;
+  UINT32  Last;
+  UINT64  Word;
+  UINT64  Pattern;
+
+  if (StringSize == 0 || StringSize > DataSize || DataSize > MAX_INT32) {
+    return -1;
+  }
+
+  Last    = DataSize - StringSize;
+  Pattern = MultU64x32 (0x0101010101010101ULL, (UINT8) String[0]);
+  Offset  = 0;
+
+  while (Offset <= Last) {
+    if (Last - Offset >= sizeof (UINT64)) {
+      //
+      // Skip words which contain no bytes equal to the first character.
+      //
+      Word = ReadUnaligned64 ((CONST UINT64 *) &Data[Offset]) ^ Pattern;
+      if (((Word - 0x0101010101010101ULL) & ~Word & 0x8080808080808080ULL) == 0) {
+        Offset += sizeof (UINT64);
+        continue;
+      }
+
+      for (Index = 0; Index < sizeof (UINT64); ++Index, ++Offset) {
+        if (Data[Offset] == (UINT8) String[0]
+          && CompareMem (&Data[Offset], String, StringSize) == 0) {
+          return (INT32) Offset;
+        }
+      }
+    } else {
+      if (Data[Offset] == (UINT8) String[0]
+        && CompareMem (&Data[Offset], String, StringSize) == 0) {
+        return (INT32) Offset;
+      }
+
+      ++Offset;
+    }
+  }
+
+  return -1;
+}
+
+/**
+  Find Darwin version string in the sections it is normally stored in.
+**/
+STATIC
+INT32
+OcKernelFindDarwinVersion (
+  IN  CONST UINT8   *Kernel,
+  IN  UINT32        KernelSize
+  )
+{
+  OC_MACHO_CONTEXT  Context;
+  MACH_SECTION_64   *Section;
+  INT32             Offset;
+  UINT32            Index;
+
+  STATIC CONST CHAR8 *mDarwinVersionSections[][2] = {
+    {"__TEXT", "__const"},
+    {"__DATA", "__const"}
+  };
+
+  if (!MachoInitializeContext (&Context, (VOID *) Kernel, KernelSize)) {
+    return -1;
+  }
+
+  for (Index = 0; Index < ARRAY_SIZE (mDarwinVersionSections); ++Index) {
+    Section = MachoGetSegmentSectionByName64 (
+      &Context,
+      mDarwinVersionSections[Index][0],
+      mDarwinVersionSections[Index][1]
+      );
+
+    if (Section == NULL
+      || Section->Offset > KernelSize
+      || Section->Size > KernelSize - Section->Offset) {
+      continue;
+    }
+
+    Offset = OcKernelFindString (
+      &Kernel[Section->Offset],
+      (UINT32) Section->Size,
+      "Darwin Kernel Version ",
+      L_STR_LEN ("Darwin Kernel Version ")
+      );
+
+    if (Offset >= 0) {
+      return (INT32) Section->Offset + Offset;
+    }
+  }
+
+  return -1;
+}
+
 STATIC
 UINT32
 OcKernelReadDarwinVersion (
@@ -131,15 +408,16 @@ OcKernelReadDarwinVersion (
   CHAR8   DarwinVersion[32];
   UINT32  DarwinVersionInteger;
 
+  Offset = OcKernelFindDarwinVersion (Kernel, KernelSize);
 
-  Offset = FindPattern (
-    (CONST UINT8 *) "Darwin Kernel Version ",
-    NULL,
-    L_STR_LEN ("Darwin Kernel Version "),
-    Kernel,
-    KernelSize,
-    0
-    );
+  if (Offset < 0) {
+    Offset = OcKernelFindString (
+      Kernel,
+      KernelSize,
+      "Darwin Kernel Version ",
+      L_STR_LEN ("Darwin Kernel Version ")
+      );
+  }
 
   if (Offset < 0) {
     DEBUG ((DEBUG_WARN, "OC: Failed to determine kernel version\n"));
@@ -167,6 +445,125 @@ OcKernelReadDarwinVersion (
   return DarwinVersionInteger;
 }
 
+/**
+  Compute space needed to inject the kext from its plist and Mach-O
+  virtual size, as injected executables are laid out by segments.
+
+  @retval size or 0 when the kext cannot be parsed.
+**/
+STATIC
+UINT32
+OcKernelGetExactKextSize (
+  IN OC_KERNEL_ADD_ENTRY  *Kext
+  )
+{
+  OC_MACHO_CONTEXT  Context;
+  UINT32            Size;
+  UINT32            VmSize;
+
+  if (OcOverflowAddU32 (Kext->PlistDataSize, OC_KERNEL_KEXT_INFO_EXTRA_SIZE, &Size)) {
+    return 0;
+  }
+
+  if (Kext->ImageData != NULL) {
+    if (!MachoInitializeContext (&Context, Kext->ImageData, Kext->ImageDataSize)) {
+      return 0;
+    }
+
+    VmSize = MachoGetVmSize64 (&Context);
+    if (VmSize == 0
+      || VmSize > MAX_UINT32 - EFI_PAGE_SIZE
+      || OcOverflowAddU32 (Size, ALIGN_VALUE (VmSize, EFI_PAGE_SIZE), &Size)) {
+      return 0;
+    }
+  }
+
+  return Size;
+}
+
+/**
+  Decompress kext file stored in compressed container, files stored
+  as is are left untouched. Vault verifies the file before this.
+
+  @param[in]     FullPath  File path for logging.
+  @param[in,out] Data      File data, replaced on decompression.
+  @param[in,out] DataSize  File data size, replaced on decompression.
+
+  @retval EFI_SUCCESS on success.
+**/
+STATIC
+EFI_STATUS
+OcKernelDecompressKextFile (
+  IN     CONST CHAR16  *FullPath,
+  IN OUT UINT8         **Data,
+  IN OUT UINT32        *DataSize
+  )
+{
+  MACH_COMP_HEADER  *Header;
+  UINT8             *Buffer;
+  UINT32            CompressedSize;
+  UINT32            DecompressedSize;
+  UINT32            Result;
+
+  if (*DataSize < sizeof (MACH_COMP_HEADER)
+    || ReadUnaligned32 ((UINT32 *) *Data) != MACH_COMPRESSED_BINARY_INVERT_SIGNATURE) {
+    return EFI_SUCCESS;
+  }
+
+  Header           = (MACH_COMP_HEADER *) *Data;
+  CompressedSize   = SwapBytes32 (Header->Compressed);
+  DecompressedSize = SwapBytes32 (Header->Decompressed);
+
+  if (CompressedSize > *DataSize - sizeof (MACH_COMP_HEADER)
+    || DecompressedSize == 0
+    || DecompressedSize > OC_KERNEL_KEXT_MAX_DECOMPRESSED_SIZE) {
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  Buffer = AllocatePool (DecompressedSize);
+  if (Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  if (Header->Compression == MACH_COMPRESSED_BINARY_INVERT_LZVN) {
+    Result = (UINT32) DecompressLZVN (
+      Buffer,
+      DecompressedSize,
+      *Data + sizeof (MACH_COMP_HEADER),
+      CompressedSize
+      );
+  } else if (Header->Compression == MACH_COMPRESSED_BINARY_INVERT_LZSS) {
+    Result = DecompressLZSS (
+      Buffer,
+      DecompressedSize,
+      *Data + sizeof (MACH_COMP_HEADER),
+      CompressedSize
+      );
+  } else {
+    FreePool (Buffer);
+    return EFI_UNSUPPORTED;
+  }
+
+  if (Result != DecompressedSize || Adler32 (Buffer, DecompressedSize) != SwapBytes32 (Header->Hash)) {
+    FreePool (Buffer);
+    return EFI_VOLUME_CORRUPTED;
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "OC: Decompressed %s from %u to %u bytes\n",
+    FullPath,
+    *DataSize,
+    DecompressedSize
+    ));
+
+  FreePool (*Data);
+  *Data     = Buffer;
+  *DataSize = DecompressedSize;
+
+  return EFI_SUCCESS;
+}
+
 STATIC
 UINT32
 OcKernelLoadKextsAndReserve (
@@ -174,8 +571,12 @@ OcKernelLoadKextsAndReserve (
   IN OC_GLOBAL_CONFIG    *Config
   )
 {
+  EFI_STATUS           Status;
   UINT32               Index;
   UINT32               ReserveSize;
+  UINT32               ExactReserveSize;
+  UINT32               ExactKextSize;
+  BOOLEAN              HasExactSize;
   CHAR8                *BundlePath;
   CHAR8                *Comment;
   CHAR8                *PlistPath;
@@ -183,7 +584,9 @@ OcKernelLoadKextsAndReserve (
   CHAR16               FullPath[128];
   OC_KERNEL_ADD_ENTRY  *Kext;
 
-  ReserveSize = PRELINK_INFO_RESERVE_SIZE;
+  ReserveSize      = PRELINK_INFO_RESERVE_SIZE;
+  ExactReserveSize = PRELINK_INFO_RESERVE_SIZE;
+  HasExactSize     = TRUE;
 
   for (Index = 0; Index < Config->Kernel.Add.Count; ++Index) {
     Kext = Config->Kernel.Add.Values[Index];
@@ -230,6 +633,23 @@ OcKernelLoadKextsAndReserve (
         continue;
       }
 
+      Status = OcKernelDecompressKextFile (FullPath, &Kext->PlistData, &Kext->PlistDataSize);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((
+          DEBUG_ERROR,
+          "OC: Plist %s is invalid for kext %a (%a) - %r\n",
+          FullPath,
+          BundlePath,
+          Comment,
+          Status
+          ));
+        FreePool (Kext->PlistData);
+        Kext->PlistData     = NULL;
+        Kext->PlistDataSize = 0;
+        Kext->Enabled       = FALSE;
+        continue;
+      }
+
       ExecutablePath = OC_BLOB_GET (&Kext->ExecutablePath);
       if (ExecutablePath[0] != '\0') {
         UnicodeSPrint (
@@ -259,6 +679,23 @@ OcKernelLoadKextsAndReserve (
           Kext->Enabled = FALSE;
           continue;
         }
+
+        Status = OcKernelDecompressKextFile (FullPath, &Kext->ImageData, &Kext->ImageDataSize);
+        if (EFI_ERROR (Status)) {
+          DEBUG ((
+            DEBUG_ERROR,
+            "OC: Image %s is invalid for kext %a (%a) - %r\n",
+            FullPath,
+            BundlePath,
+            Comment,
+            Status
+            ));
+          FreePool (Kext->ImageData);
+          Kext->ImageData     = NULL;
+          Kext->ImageDataSize = 0;
+          Kext->Enabled       = FALSE;
+          continue;
+        }
       }
     }
 
@@ -268,6 +705,23 @@ OcKernelLoadKextsAndReserve (
       Kext->ImageData,
       Kext->ImageDataSize
       );
+
+    ExactKextSize = OcKernelGetExactKextSize (Kext);
+    if (ExactKextSize == 0 || OcOverflowAddU32 (ExactReserveSize, ExactKextSize, &ExactReserveSize)) {
+      HasExactSize = FALSE;
+    }
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "OC: Kext conservative reservation %u, exact %u (%a)\n",
+    ReserveSize,
+    HasExactSize ? ExactReserveSize : 0,
+    HasExactSize ? "valid" : "invalid"
+    ));
+
+  if (OC_KERNEL_EXACT_RESERVE && HasExactSize) {
+    ReserveSize = ExactReserveSize;
   }
 
   DEBUG ((DEBUG_INFO, "Kext reservation size %u\n", ReserveSize));
@@ -275,28 +729,536 @@ OcKernelLoadKextsAndReserve (
   return ReserveSize;
 }
 
+STATIC
+VOID
+OcKernelInitGenericPatch (
+  IN  OC_KERNEL_PATCH_ENTRY  *UserPatch,
+  OUT PATCHER_GENERIC_PATCH  *Patch
+  )
+{
+  ZeroMem (Patch, sizeof (*Patch));
+
+  if (OC_BLOB_GET (&UserPatch->Comment)[0] != '\0') {
+    Patch->Comment  = OC_BLOB_GET (&UserPatch->Comment);
+  }
+
+  if (OC_BLOB_GET (&UserPatch->Base)[0] != '\0') {
+    Patch->Base  = OC_BLOB_GET (&UserPatch->Base);
+  }
+
+  if (UserPatch->Find.Size > 0) {
+    Patch->Find  = OC_BLOB_GET (&UserPatch->Find);
+  }
+
+  Patch->Replace = OC_BLOB_GET (&UserPatch->Replace);
+
+  if (UserPatch->Mask.Size > 0) {
+    Patch->Mask  = OC_BLOB_GET (&UserPatch->Mask);
+  }
+
+  if (UserPatch->ReplaceMask.Size > 0) {
+    Patch->ReplaceMask = OC_BLOB_GET (&UserPatch->ReplaceMask);
+  }
+
+  Patch->Size    = UserPatch->Replace.Size;
+  Patch->Count   = UserPatch->Count;
+  Patch->Skip    = UserPatch->Skip;
+  Patch->Limit   = UserPatch->Limit;
+}
+
+STATIC
+UINT32
+OcKernelInternIdentifier (
+  IN CONST CHAR8  *Identifier
+  )
+{
+  UINT32  Index;
+
+  for (Index = 0; Index < mOcKernelIdentifierCount; ++Index) {
+    if (AsciiStrCmp (mOcKernelIdentifiers[Index], Identifier) == 0) {
+      return Index;
+    }
+  }
+
+  mOcKernelIdentifiers[mOcKernelIdentifierCount] = Identifier;
+  return mOcKernelIdentifierCount++;
+}
+
+STATIC
+VOID
+OcKernelFreeCompiledConfig (
+  VOID
+  )
+{
+  if (mOcKernelPatches != NULL) {
+    FreePool (mOcKernelPatches);
+    mOcKernelPatches = NULL;
+  }
+
+  if (mOcKernelBlocks != NULL) {
+    FreePool (mOcKernelBlocks);
+    mOcKernelBlocks = NULL;
+  }
+
+  if (mOcKernelAdds != NULL) {
+    FreePool (mOcKernelAdds);
+    mOcKernelAdds = NULL;
+  }
+
+  if (mOcKernelIdentifiers != NULL) {
+    FreePool (mOcKernelIdentifiers);
+    mOcKernelIdentifiers = NULL;
+  }
+
+  mOcKernelIdentifierCount = 0;
+}
+
+STATIC
+VOID
+OcKernelCompileEntry (
+  IN  CONST CHAR8           *Target  OPTIONAL,
+  IN  CONST CHAR8           *MinKernel,
+  IN  CONST CHAR8           *MaxKernel,
+  IN  UINT32                Identifier,
+  OUT OC_KERNEL_ENTRY_INFO  *Info
+  )
+{
+  Info->Identifier = Identifier;
+  Info->Target     = Target;
+  Info->MinKernel  = OcParseDarwinVersion (MinKernel);
+  Info->MaxKernel  = OcParseDarwinVersion (MaxKernel);
+}
+
+STATIC
+VOID
+OcKernelCompilePatch (
+  IN  OC_GLOBAL_CONFIG      *Config,
+  IN  UINT32                Index,
+  IN  UINT32                Identifier,
+  OUT OC_KERNEL_PATCH_INFO  *PatchInfo
+  )
+{
+  OC_KERNEL_PATCH_ENTRY  *UserPatch;
+  CONST CHAR8            *Target;
+
+  UserPatch = Config->Kernel.Patch.Values[Index];
+  Target    = OC_BLOB_GET (&UserPatch->Identifier);
+
+  ZeroMem (PatchInfo, sizeof (*PatchInfo));
+  OcKernelCompileEntry (
+    Target,
+    OC_BLOB_GET (&UserPatch->MinKernel),
+    OC_BLOB_GET (&UserPatch->MaxKernel),
+    Identifier,
+    &PatchInfo->Entry
+    );
+  PatchInfo->IsKernel = AsciiStrCmp (Target, "kernel") == 0;
+
+  if (!UserPatch->Enabled) {
+    return;
+  }
+
+  //
+  // Ignore patch if:
+  // - There is nothing to replace.
+  // - We have neither symbolic base, nor find data.
+  // - Find and replace mismatch in size.
+  // - Mask and ReplaceMask mismatch in size when are available.
+  //
+  if (UserPatch->Replace.Size == 0
+    || (OC_BLOB_GET (&UserPatch->Base)[0] == '\0' && UserPatch->Find.Size != UserPatch->Replace.Size)
+    || (UserPatch->Mask.Size > 0 && UserPatch->Find.Size != UserPatch->Mask.Size)
+    || (UserPatch->ReplaceMask.Size > 0 && UserPatch->Find.Size != UserPatch->ReplaceMask.Size)) {
+    DEBUG ((
+      DEBUG_ERROR,
+      "OC: Kernel patch %u for %a (%a) is borked\n",
+      Index,
+      Target,
+      OC_BLOB_GET (&UserPatch->Comment)
+      ));
+    return;
+  }
+
+  OcKernelInitGenericPatch (UserPatch, &PatchInfo->Patch);
+  PatchInfo->Enabled = TRUE;
+}
+
+/**
+  Obtain compiled kernel patch. When the configuration could not be
+  compiled the patch is compiled into the scratch buffer on every call.
+**/
+STATIC
+OC_KERNEL_PATCH_INFO *
+OcKernelGetPatchInfo (
+  IN  OC_GLOBAL_CONFIG      *Config,
+  IN  UINT32                Index,
+  OUT OC_KERNEL_PATCH_INFO  *Scratch
+  )
+{
+  if (mOcKernelPatches != NULL) {
+    return &mOcKernelPatches[Index];
+  }
+
+  OcKernelCompilePatch (Config, Index, MAX_UINT32, Scratch);
+  return Scratch;
+}
+
+/**
+  Obtain compiled kernel block entry, see OcKernelGetPatchInfo.
+**/
+STATIC
+CONST OC_KERNEL_ENTRY_INFO *
+OcKernelGetBlockInfo (
+  IN  OC_GLOBAL_CONFIG      *Config,
+  IN  UINT32                Index,
+  OUT OC_KERNEL_ENTRY_INFO  *Scratch
+  )
+{
+  OC_KERNEL_BLOCK_ENTRY  *Block;
+
+  if (mOcKernelBlocks != NULL) {
+    return &mOcKernelBlocks[Index];
+  }
+
+  Block = Config->Kernel.Block.Values[Index];
+  OcKernelCompileEntry (
+    OC_BLOB_GET (&Block->Identifier),
+    OC_BLOB_GET (&Block->MinKernel),
+    OC_BLOB_GET (&Block->MaxKernel),
+    MAX_UINT32,
+    Scratch
+    );
+  return Scratch;
+}
+
+/**
+  Obtain compiled kernel add entry, see OcKernelGetPatchInfo.
+**/
+STATIC
+CONST OC_KERNEL_ENTRY_INFO *
+OcKernelGetAddInfo (
+  IN  OC_GLOBAL_CONFIG      *Config,
+  IN  UINT32                Index,
+  OUT OC_KERNEL_ENTRY_INFO  *Scratch
+  )
+{
+  OC_KERNEL_ADD_ENTRY  *Kext;
+
+  if (mOcKernelAdds != NULL) {
+    return &mOcKernelAdds[Index];
+  }
+
+  Kext = Config->Kernel.Add.Values[Index];
+  OcKernelCompileEntry (
+    NULL,
+    OC_BLOB_GET (&Kext->MinKernel),
+    OC_BLOB_GET (&Kext->MaxKernel),
+    MAX_UINT32,
+    Scratch
+    );
+  return Scratch;
+}
+
+STATIC
+EFI_STATUS
+OcKernelCompileConfig (
+  IN OC_GLOBAL_CONFIG  *Config
+  )
+{
+  UINT32                 Index;
+  OC_KERNEL_PATCH_ENTRY  *UserPatch;
+  OC_KERNEL_BLOCK_ENTRY  *Block;
+  OC_KERNEL_ADD_ENTRY    *Kext;
+  OC_KERNEL_PATCH_INFO   *PatchInfo;
+
+  //
+  // Allocate at least one element to make empty lists distinguishable.
+  //
+  mOcKernelPatches     = AllocateZeroPool (MAX (Config->Kernel.Patch.Count, 1) * sizeof (*mOcKernelPatches));
+  mOcKernelBlocks      = AllocateZeroPool (MAX (Config->Kernel.Block.Count, 1) * sizeof (*mOcKernelBlocks));
+  mOcKernelAdds        = AllocateZeroPool (MAX (Config->Kernel.Add.Count, 1) * sizeof (*mOcKernelAdds));
+  mOcKernelIdentifiers = AllocatePool (
+    MAX (Config->Kernel.Patch.Count + Config->Kernel.Block.Count, 1) * sizeof (*mOcKernelIdentifiers)
+    );
+
+  if (mOcKernelPatches == NULL
+    || mOcKernelBlocks == NULL
+    || mOcKernelAdds == NULL
+    || mOcKernelIdentifiers == NULL) {
+    OcKernelFreeCompiledConfig ();
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  for (Index = 0; Index < Config->Kernel.Patch.Count; ++Index) {
+    UserPatch = Config->Kernel.Patch.Values[Index];
+    PatchInfo = &mOcKernelPatches[Index];
+
+    OcKernelCompilePatch (
+      Config,
+      Index,
+      OcKernelInternIdentifier (OC_BLOB_GET (&UserPatch->Identifier)),
+      PatchInfo
+      );
+  }
+
+  for (Index = 0; Index < Config->Kernel.Block.Count; ++Index) {
+    Block = Config->Kernel.Block.Values[Index];
+
+    OcKernelCompileEntry (
+      OC_BLOB_GET (&Block->Identifier),
+      OC_BLOB_GET (&Block->MinKernel),
+      OC_BLOB_GET (&Block->MaxKernel),
+      OcKernelInternIdentifier (OC_BLOB_GET (&Block->Identifier)),
+      &mOcKernelBlocks[Index]
+      );
+  }
+
+  for (Index = 0; Index < Config->Kernel.Add.Count; ++Index) {
+    Kext = Config->Kernel.Add.Values[Index];
+
+    OcKernelCompileEntry (
+      NULL,
+      OC_BLOB_GET (&Kext->MinKernel),
+      OC_BLOB_GET (&Kext->MaxKernel),
+      MAX_UINT32,
+      &mOcKernelAdds[Index]
+      );
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "OC: Compiled %u patches, %u blocks, %u kexts with %u identifiers\n",
+    Config->Kernel.Patch.Count,
+    Config->Kernel.Block.Count,
+    Config->Kernel.Add.Count,
+    mOcKernelIdentifierCount
+    ));
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Obtain patcher context for the kext with the interned identifier.
+  When the kext patcher table is available each kext is looked up in
+  prelinked info at most once, otherwise the context is looked up again
+  in the scratch buffer.
+**/
+STATIC
+EFI_STATUS
+OcKernelGetKextPatcher (
+  IN     PRELINKED_CONTEXT       *Context,
+  IN OUT OC_KERNEL_KEXT_PATCHER  *KextPatchers  OPTIONAL,
+  IN     CONST OC_KERNEL_ENTRY_INFO  *Entry,
+  IN OUT PATCHER_CONTEXT         *Scratch,
+  OUT    PATCHER_CONTEXT         **Patcher
+  )
+{
+  UINT32  Identifier;
+
+  Identifier = Entry->Identifier;
+
+  if (KextPatchers == NULL || Identifier == MAX_UINT32) {
+    *Patcher = Scratch;
+    return PatcherInitContextFromPrelinked (
+      Scratch,
+      Context,
+      Entry->Target
+      );
+  }
+
+  if (!KextPatchers[Identifier].Resolved) {
+    KextPatchers[Identifier].Status = PatcherInitContextFromPrelinked (
+      &KextPatchers[Identifier].Patcher,
+      Context,
+      Entry->Target
+      );
+    KextPatchers[Identifier].Resolved = TRUE;
+  }
+
+  *Patcher = &KextPatchers[Identifier].Patcher;
+  return KextPatchers[Identifier].Status;
+}
+
+STATIC
+VOID
+OcKernelReportPatch (
+  IN OC_GLOBAL_CONFIG  *Config,
+  IN UINT32            Index,
+  IN EFI_STATUS        Status
+  )
+{
+  DEBUG ((
+    EFI_ERROR (Status) ? DEBUG_WARN : DEBUG_INFO,
+    "OC: Kernel patcher result %u for %a (%a) - %r\n",
+    Index,
+    OC_BLOB_GET (&Config->Kernel.Patch.Values[Index]->Identifier),
+    OC_BLOB_GET (&Config->Kernel.Patch.Values[Index]->Comment),
+    Status
+    ));
+}
+
+STATIC
+VOID
+OcKernelFlushPatchBatch (
+  IN     OC_GLOBAL_CONFIG       *Config,
+  IN OUT PATCHER_CONTEXT        *Patcher,
+  IN OUT UINT8                  *Kernel,
+  IN     UINT32                 Size,
+  IN OUT OC_BATCH_PATCH         *Batch,
+  IN     UINT32                 *BatchIndices,
+  IN OUT UINT32                 *BatchCount,
+  IN OUT OC_KERNEL_PATCH_HINTS  *Hints  OPTIONAL
+  )
+{
+  EFI_STATUS                 Status;
+  EFI_STATUS                 PatchStatus;
+  UINT32                     Index;
+  UINT32                     Matches;
+  UINT8                      HintKey[SHA256_DIGEST_SIZE];
+  PATCHER_GENERIC_PATCH      Patch;
+  CONST OC_BATCH_PATCH_HINT  *Entries;
+  UINT32                     LoadedCount;
+  BOOLEAN                    HasLoaded;
+  OC_BATCH_PATCH_HINT        *NewEntries;
+  UINT32                     EntryCount;
+
+  if (*BatchCount == 0) {
+    return;
+  }
+
+  Status     = EFI_NOT_FOUND;
+  NewEntries = NULL;
+  EntryCount = 0;
+  HasLoaded  = FALSE;
+
+  //
+  // Prelinked kernel may be rebuilt by kextcache keeping kernel LC_UUID,
+  // so hints are verified to still be the first occurrences. This is only
+  // cheaper than scanning when every patch replaces a fixed amount of
+  // occurrences from the start, as the rest of the kernel is not searched.
+  //
+  if (Hints != NULL) {
+    for (Index = 0; Index < *BatchCount; ++Index) {
+      if (Batch[Index].Count == 0 || Batch[Index].Skip > 0) {
+        Hints = NULL;
+        break;
+      }
+    }
+  }
+
+  //
+  // Same kernel build and same patches give the same occurrences,
+  // so try them first and only scan the kernel when they do not match.
+  //
+  if (Hints != NULL) {
+    OcKernelCacheGetHintKey (
+      Hints->Uuid->Uuid,
+      sizeof (Hints->Uuid->Uuid),
+      Size,
+      Batch,
+      *BatchCount,
+      HintKey
+      );
+
+    HasLoaded = OcKernelCacheFindHints (Hints->Loaded, Hints->LoadedSize, HintKey, &Entries, &LoadedCount);
+    if (HasLoaded) {
+      EntryCount = LoadedCount;
+      Status     = OcApplyBatchPatchHints (Batch, *BatchCount, Kernel, Size, Entries, EntryCount);
+    }
+
+    if (!EFI_ERROR (Status)) {
+      ++Hints->Hits;
+      OcKernelCacheAddHints (&Hints->Updated, &Hints->UpdatedSize, HintKey, Entries, EntryCount);
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    Status = OcApplyBatchPatches (
+      Batch,
+      *BatchCount,
+      Kernel,
+      Size,
+      Hints != NULL ? &NewEntries : NULL,
+      &EntryCount
+      );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_INFO, "OC: Kernel patcher falls back for %u patches - %r\n", *BatchCount, Status));
+    }
+
+    if (Hints != NULL && !EFI_ERROR (Status)) {
+      Matches = 0;
+      for (Index = 0; Index < *BatchCount; ++Index) {
+        Matches += Batch[Index].ReplaceCount;
+      }
+
+      //
+      // Hints are only recorded when every occurrence was returned.
+      // Hint file is only rewritten when recorded occurrences differ.
+      //
+      if (Matches == EntryCount) {
+        if (!HasLoaded
+          || LoadedCount != EntryCount
+          || (EntryCount > 0 && CompareMem (Entries, NewEntries, EntryCount * sizeof (*Entries)) != 0)) {
+          Hints->Changed = TRUE;
+        }
+        OcKernelCacheAddHints (&Hints->Updated, &Hints->UpdatedSize, HintKey, NewEntries, EntryCount);
+      }
+    }
+
+    if (NewEntries != NULL) {
+      FreePool (NewEntries);
+    }
+  }
+
+  for (Index = 0; Index < *BatchCount; ++Index) {
+    if (EFI_ERROR (Status)) {
+      OcKernelInitGenericPatch (Config->Kernel.Patch.Values[BatchIndices[Index]], &Patch);
+      PatchStatus = PatcherApplyGenericPatch (Patcher, &Patch);
+    } else if (Batch[Index].ReplaceCount > 0
+      && (Batch[Index].Count == 0 || Batch[Index].ReplaceCount == Batch[Index].Count)) {
+      PatchStatus = EFI_SUCCESS;
+    } else {
+      PatchStatus = EFI_NOT_FOUND;
+    }
+
+    OcKernelReportPatch (Config, BatchIndices[Index], PatchStatus);
+  }
+
+  *BatchCount = 0;
+}
+
 STATIC
 VOID
 OcKernelApplyPatches (
-  IN     OC_GLOBAL_CONFIG  *Config,
-  IN     UINT32            DarwinVersion,
-  IN     PRELINKED_CONTEXT *Context,
-  IN OUT UINT8             *Kernel,
-  IN     UINT32            Size
+  IN     OC_GLOBAL_CONFIG        *Config,
+  IN     UINT32                  DarwinVersion,
+  IN     PRELINKED_CONTEXT       *Context,
+  IN OUT OC_KERNEL_KEXT_PATCHER  *KextPatchers  OPTIONAL,
+  IN OUT UINT8                   *Kernel,
+  IN     UINT32                  Size
   )
 {
   EFI_STATUS             Status;
   PATCHER_CONTEXT        Patcher;
+  PATCHER_CONTEXT        *CurrentPatcher;
   UINT32                 Index;
-  PATCHER_GENERIC_PATCH  Patch;
-  OC_KERNEL_PATCH_ENTRY  *UserPatch;
+  OC_KERNEL_PATCH_INFO   *PatchInfo;
+  OC_KERNEL_PATCH_INFO   PatchScratch;
   CONST CHAR8            *Target;
   CONST CHAR8            *Comment;
-  UINT32                 MaxKernel;
-  UINT32                 MinKernel;
   BOOLEAN                IsKernelPatch;
-
-  IsKernelPatch = Context == NULL;
+  OC_BATCH_PATCH         *Batch;
+  UINT32                 *BatchIndices;
+  UINT32                 BatchCount;
+  OC_KERNEL_PATCH_HINTS  HintStorage;
+  OC_KERNEL_PATCH_HINTS  *Hints;
+
+  IsKernelPatch  = Context == NULL;
+  CurrentPatcher = &Patcher;
+  Batch          = NULL;
+  BatchIndices  = NULL;
+  BatchCount    = 0;
+  Hints         = NULL;
 
   if (IsKernelPatch) {
     ASSERT (Kernel != NULL);
@@ -311,39 +1273,74 @@ OcKernelApplyPatches (
       DEBUG ((DEBUG_ERROR, "OC: Kernel patcher kernel init failure - %r\n", Status));
       return;
     }
+
+    //
+    // Find and replace kernel patches are collected and applied in a single
+    // pass over the kernel. On allocation failure we patch one by one.
+    //
+    if (Config->Kernel.Patch.Count > 0) {
+      Batch        = AllocatePool (Config->Kernel.Patch.Count * sizeof (*Batch));
+      BatchIndices = AllocatePool (Config->Kernel.Patch.Count * sizeof (*BatchIndices));
+      if (Batch == NULL || BatchIndices == NULL) {
+        if (Batch != NULL) {
+          FreePool (Batch);
+          Batch = NULL;
+        }
+        if (BatchIndices != NULL) {
+          FreePool (BatchIndices);
+          BatchIndices = NULL;
+        }
+      }
+    }
+
+    //
+    // Patch offset hints are stored next to the kernel cache and keyed
+    // by kernel LC_UUID, which changes with every kernel build, and by
+    // prelinked kernel size. Like the cache they are neither read nor
+    // written unless KernelCache directory exists.
+    //
+    if (Batch != NULL && mOcKernelCacheEnabled) {
+      ZeroMem (&HintStorage, sizeof (HintStorage));
+      HintStorage.Uuid = MachoGetUuid64 (&Patcher.MachContext);
+      if (HintStorage.Uuid != NULL) {
+        Hints  = &HintStorage;
+        Status = OcKernelCacheLoadHints (mOcStorage, &Hints->Loaded, &Hints->LoadedSize);
+        DEBUG ((DEBUG_INFO, "OC: Kernel patch hints load - %r\n", Status));
+      }
+    }
   }
 
   for (Index = 0; Index < Config->Kernel.Patch.Count; ++Index) {
-    UserPatch = Config->Kernel.Patch.Values[Index];
-    Target    = OC_BLOB_GET (&UserPatch->Identifier);
-    Comment   = OC_BLOB_GET (&UserPatch->Comment);
+    PatchInfo = OcKernelGetPatchInfo (Config, Index, &PatchScratch);
 
-    if (!UserPatch->Enabled || (AsciiStrCmp (Target, "kernel") == 0) != IsKernelPatch) {
+    if (!PatchInfo->Enabled || PatchInfo->IsKernel != IsKernelPatch) {
       continue;
     }
 
-    MaxKernel   = OcParseDarwinVersion (OC_BLOB_GET (&UserPatch->MaxKernel));
-    MinKernel   = OcParseDarwinVersion (OC_BLOB_GET (&UserPatch->MinKernel));
+    Target    = PatchInfo->Entry.Target;
+    Comment   = OC_BLOB_GET (&Config->Kernel.Patch.Values[Index]->Comment);
 
-    if (!OcMatchDarwinVersion (DarwinVersion, MinKernel, MaxKernel)) {
+    if (!OcMatchDarwinVersion (DarwinVersion, PatchInfo->Entry.MinKernel, PatchInfo->Entry.MaxKernel)) {
       DEBUG ((
         DEBUG_INFO,
         "OC: Kernel patcher skips %a (%a) patch at %u due to version %u <= %u <= %u\n",
         Target,
         Comment,
         Index,
-        MinKernel,
+        PatchInfo->Entry.MinKernel,
         DarwinVersion,
-        MaxKernel
+        PatchInfo->Entry.MaxKernel
         ));
       continue;
     }
 
     if (!IsKernelPatch) {
-      Status = PatcherInitContextFromPrelinked (
-        &Patcher,
+      Status = OcKernelGetKextPatcher (
         Context,
-        Target
+        KextPatchers,
+        &PatchInfo->Entry,
+        &Patcher,
+        &CurrentPatcher
         );
 
       if (EFI_ERROR (Status)) {
@@ -354,59 +1351,55 @@ OcKernelApplyPatches (
       }
     }
 
-    //
-    // Ignore patch if:
-    // - There is nothing to replace.
-    // - We have neither symbolic base, nor find data.
-    // - Find and replace mismatch in size.
-    // - Mask and ReplaceMask mismatch in size when are available.
-    //
-    if (UserPatch->Replace.Size == 0
-      || (OC_BLOB_GET (&UserPatch->Base)[0] == '\0' && UserPatch->Find.Size != UserPatch->Replace.Size)
-      || (UserPatch->Mask.Size > 0 && UserPatch->Find.Size != UserPatch->Mask.Size)
-      || (UserPatch->ReplaceMask.Size > 0 && UserPatch->Find.Size != UserPatch->ReplaceMask.Size)) {
-      DEBUG ((DEBUG_ERROR, "OC: Kernel patch %u for %a (%a) is borked\n", Index, Target, Comment));
-      continue;
-    }
-
-    ZeroMem (&Patch, sizeof (Patch));
+    if (Batch != NULL) {
+      //
+      // Symbol-based patches are applied in place, so flush the batch
+      // before them to preserve the patch order.
+      //
+      if (PatchInfo->Patch.Base == NULL) {
+        Batch[BatchCount].Find         = PatchInfo->Patch.Find;
+        Batch[BatchCount].Mask         = PatchInfo->Patch.Mask;
+        Batch[BatchCount].Replace      = PatchInfo->Patch.Replace;
+        Batch[BatchCount].ReplaceMask  = PatchInfo->Patch.ReplaceMask;
+        Batch[BatchCount].Size         = PatchInfo->Patch.Size;
+        Batch[BatchCount].Count        = PatchInfo->Patch.Count;
+        Batch[BatchCount].Skip         = PatchInfo->Patch.Skip;
+        Batch[BatchCount].Limit        = PatchInfo->Patch.Limit;
+        Batch[BatchCount].ReplaceCount = 0;
+        BatchIndices[BatchCount]       = Index;
+        ++BatchCount;
+        continue;
+      }
 
-    if (OC_BLOB_GET (&UserPatch->Comment)[0] != '\0') {
-      Patch.Comment  = OC_BLOB_GET (&UserPatch->Comment);
+      OcKernelFlushPatchBatch (Config, &Patcher, Kernel, Size, Batch, BatchIndices, &BatchCount, Hints);
     }
 
-    if (OC_BLOB_GET (&UserPatch->Base)[0] != '\0') {
-      Patch.Base  = OC_BLOB_GET (&UserPatch->Base);
-    }
+    Status = PatcherApplyGenericPatch (CurrentPatcher, &PatchInfo->Patch);
 
-    if (UserPatch->Find.Size > 0) {
-      Patch.Find  = OC_BLOB_GET (&UserPatch->Find);
-    }
+    OcKernelReportPatch (Config, Index, Status);
+  }
 
-    Patch.Replace = OC_BLOB_GET (&UserPatch->Replace);
+  if (Batch != NULL) {
+    OcKernelFlushPatchBatch (Config, &Patcher, Kernel, Size, Batch, BatchIndices, &BatchCount, Hints);
+    FreePool (Batch);
+    FreePool (BatchIndices);
+  }
 
-    if (UserPatch->Mask.Size > 0) {
-      Patch.Mask  = OC_BLOB_GET (&UserPatch->Mask);
-    }
+  if (Hints != NULL) {
+    DEBUG ((DEBUG_INFO, "OC: Kernel patch hints used for %u batches\n", Hints->Hits));
 
-    if (UserPatch->ReplaceMask.Size > 0) {
-      Patch.ReplaceMask = OC_BLOB_GET (&UserPatch->ReplaceMask);
+    if (Hints->Changed && Hints->Updated != NULL) {
+      OcKernelCacheMergeHints (&Hints->Updated, &Hints->UpdatedSize, Hints->Loaded, Hints->LoadedSize);
+      OcKernelCacheSaveHints (mOcStorage, Hints->Updated, Hints->UpdatedSize);
     }
 
-    Patch.Size    = UserPatch->Replace.Size;
-    Patch.Count   = UserPatch->Count;
-    Patch.Skip    = UserPatch->Skip;
-    Patch.Limit   = UserPatch->Limit;
+    if (Hints->Loaded != NULL) {
+      FreePool (Hints->Loaded);
+    }
 
-    Status = PatcherApplyGenericPatch (&Patcher, &Patch);
-    DEBUG ((
-      EFI_ERROR (Status) ? DEBUG_WARN : DEBUG_INFO,
-      "OC: Kernel patcher result %u for %a (%a) - %r\n",
-      Index,
-      Target,
-      Comment,
-      Status
-      ));
+    if (Hints->Updated != NULL) {
+      FreePool (Hints->Updated);
+    }
   }
 
   if (!IsKernelPatch) {
@@ -475,50 +1468,53 @@ OcKernelApplyPatches (
 STATIC
 VOID
 OcKernelBlockKexts (
-  IN     OC_GLOBAL_CONFIG  *Config,
-  IN     UINT32            DarwinVersion,
-  IN     PRELINKED_CONTEXT *Context
+  IN     OC_GLOBAL_CONFIG        *Config,
+  IN     UINT32                  DarwinVersion,
+  IN     PRELINKED_CONTEXT       *Context,
+  IN OUT OC_KERNEL_KEXT_PATCHER  *KextPatchers  OPTIONAL
   )
 {
   EFI_STATUS             Status;
   PATCHER_CONTEXT        Patcher;
+  PATCHER_CONTEXT        *CurrentPatcher;
   UINT32                 Index;
   OC_KERNEL_BLOCK_ENTRY  *Kext;
+  CONST OC_KERNEL_ENTRY_INFO *BlockInfo;
+  OC_KERNEL_ENTRY_INFO   BlockScratch;
   CONST CHAR8            *Target;
   CONST CHAR8            *Comment;
-  UINT32                 MaxKernel;
-  UINT32                 MinKernel;
 
   for (Index = 0; Index < Config->Kernel.Block.Count; ++Index) {
-    Kext    = Config->Kernel.Block.Values[Index];
-    Target  = OC_BLOB_GET (&Kext->Identifier);
-    Comment = OC_BLOB_GET (&Kext->Comment);
+    Kext      = Config->Kernel.Block.Values[Index];
 
     if (!Kext->Enabled) {
       continue;
     }
 
-    MaxKernel = OcParseDarwinVersion (OC_BLOB_GET (&Kext->MaxKernel));
-    MinKernel = OcParseDarwinVersion (OC_BLOB_GET (&Kext->MinKernel));
+    BlockInfo = OcKernelGetBlockInfo (Config, Index, &BlockScratch);
+    Target    = BlockInfo->Target;
+    Comment   = OC_BLOB_GET (&Kext->Comment);
 
-    if (!OcMatchDarwinVersion (DarwinVersion, MinKernel, MaxKernel)) {
+    if (!OcMatchDarwinVersion (DarwinVersion, BlockInfo->MinKernel, BlockInfo->MaxKernel)) {
       DEBUG ((
         DEBUG_INFO,
         "OC: Prelink blocker skips %a (%a) block at %u due to version %u <= %u <= %u\n",
         Target,
         Comment,
         Index,
-        MinKernel,
+        BlockInfo->MinKernel,
         DarwinVersion,
-        MaxKernel
+        BlockInfo->MaxKernel
         ));
       continue;
     }
 
-    Status = PatcherInitContextFromPrelinked (
-      &Patcher,
+    Status = OcKernelGetKextPatcher (
       Context,
-      Target
+      KextPatchers,
+      BlockInfo,
+      &Patcher,
+      &CurrentPatcher
       );
 
     if (EFI_ERROR (Status)) {
@@ -526,7 +1522,7 @@ OcKernelBlockKexts (
       continue;
     }
 
-    Status = PatcherBlockKext (&Patcher);
+    Status = PatcherBlockKext (CurrentPatcher);
 
     DEBUG ((
       EFI_ERROR (Status) ? DEBUG_WARN : DEBUG_INFO,
@@ -548,24 +1544,55 @@ OcKernelProcessPrelinked (
   IN     UINT32            AllocatedSize
   )
 {
-  EFI_STATUS           Status;
-  PRELINKED_CONTEXT    Context;
-  CHAR8                *BundlePath;
-  CHAR8                *ExecutablePath;
-  CHAR8                *Comment;
-  UINT32               Index;
-  CHAR8                FullPath[128];
-  OC_KERNEL_ADD_ENTRY  *Kext;
-  UINT32               MaxKernel;
-  UINT32               MinKernel;
+  EFI_STATUS             Status;
+  PRELINKED_CONTEXT      Context;
+  CHAR8                  *BundlePath;
+  CHAR8                  *ExecutablePath;
+  CHAR8                  *Comment;
+  UINT32                 Index;
+  CHAR8                  FullPath[128];
+  OC_KERNEL_ADD_ENTRY    *Kext;
+  CONST OC_KERNEL_ENTRY_INFO *KextInfo;
+  OC_KERNEL_ENTRY_INFO   KextScratch;
+  OC_KERNEL_KEXT_PATCHER *KextPatchers;
+  UINT32                 ResolvedCount;
+  UINT32                 OriginalSize;
+
+  OriginalSize = *KernelSize;
 
   Status = PrelinkedContextInit (&Context, Kernel, *KernelSize, AllocatedSize);
 
   if (!EFI_ERROR (Status)) {
-    OcKernelApplyPatches (Config, DarwinVersion, &Context, NULL, 0);
+    //
+    // Patches and blocks targeting the same kext share one context lookup.
+    // Contexts are only valid until kext injection, which may relocate info.
+    //
+    KextPatchers = NULL;
+    if (mOcKernelIdentifierCount > 0) {
+      KextPatchers = AllocateZeroPool (mOcKernelIdentifierCount * sizeof (*KextPatchers));
+    }
+
+    OcTimingStart (OcTimingKernelPatch);
+    OcKernelApplyPatches (Config, DarwinVersion, &Context, KextPatchers, NULL, 0);
+    OcTimingStop (OcTimingKernelPatch);
 
-    OcKernelBlockKexts (Config, DarwinVersion, &Context);
+    OcTimingStart (OcTimingKernelBlock);
+    OcKernelBlockKexts (Config, DarwinVersion, &Context, KextPatchers);
+    OcTimingStop (OcTimingKernelBlock);
 
+    if (KextPatchers != NULL) {
+      ResolvedCount = 0;
+      for (Index = 0; Index < mOcKernelIdentifierCount; ++Index) {
+        if (KextPatchers[Index].Resolved) {
+          ++ResolvedCount;
+        }
+      }
+
+      DEBUG ((DEBUG_INFO, "OC: Prelinked kext lookups %u of %u identifiers\n", ResolvedCount, mOcKernelIdentifierCount));
+      FreePool (KextPatchers);
+    }
+
+    OcTimingStart (OcTimingKernelInject);
     Status = PrelinkedInjectPrepare (&Context);
     if (!EFI_ERROR (Status)) {
 
@@ -578,19 +1605,18 @@ OcKernelProcessPrelinked (
 
         BundlePath  = OC_BLOB_GET (&Kext->BundlePath);
         Comment     = OC_BLOB_GET (&Kext->Comment);
-        MaxKernel   = OcParseDarwinVersion (OC_BLOB_GET (&Kext->MaxKernel));
-        MinKernel   = OcParseDarwinVersion (OC_BLOB_GET (&Kext->MinKernel));
+        KextInfo    = OcKernelGetAddInfo (Config, Index, &KextScratch);
 
-        if (!OcMatchDarwinVersion (DarwinVersion, MinKernel, MaxKernel)) {
+        if (!OcMatchDarwinVersion (DarwinVersion, KextInfo->MinKernel, KextInfo->MaxKernel)) {
           DEBUG ((
             DEBUG_INFO,
             "OC: Prelink injection skips %a (%a) kext at %u due to version %u <= %u <= %u\n",
             BundlePath,
             Comment,
             Index,
-            MinKernel,
+            KextInfo->MinKernel,
             DarwinVersion,
-            MaxKernel
+            KextInfo->MaxKernel
             ));
           continue;
         }
@@ -625,9 +1651,18 @@ OcKernelProcessPrelinked (
       if (EFI_ERROR (Status)) {
         DEBUG ((DEBUG_WARN, "OC: Prelink insertion error - %r\n", Status));
       }
+
+      DEBUG ((
+        DEBUG_INFO,
+        "OC: Prelink reserved %u, used %u, wasted %u bytes\n",
+        AllocatedSize - OriginalSize,
+        Context.PrelinkedSize - OriginalSize,
+        AllocatedSize - Context.PrelinkedSize
+        ));
     } else {
       DEBUG ((DEBUG_WARN, "OC: Prelink inject prepare error - %r\n", Status));
     }
+    OcTimingStop (OcTimingKernelInject);
 
     *KernelSize = Context.PrelinkedSize;
 
@@ -637,6 +1672,70 @@ OcKernelProcessPrelinked (
   return Status;
 }
 
+/**
+  Check whether opened path may be a directory leading to a kernel,
+  i.e. whether its handle needs to be filtered further.
+  Only the last path component is checked, as boot.efi opens both
+  full paths and individual directories.
+**/
+STATIC
+BOOLEAN
+OcKernelIsKernelPath (
+  IN CONST CHAR16  *FileName
+  )
+{
+  UINTN  Length;
+  UINTN  Start;
+  UINTN  Index;
+  UINTN  Index2;
+
+  Length = StrLen (FileName);
+  while (Length > 0 && FileName[Length - 1] == L'\\') {
+    --Length;
+  }
+
+  Start = Length;
+  while (Start > 0 && FileName[Start - 1] != L'\\') {
+    --Start;
+  }
+
+  //
+  // Volume root.
+  //
+  if (Start == Length) {
+    return TRUE;
+  }
+
+  //
+  // APFS Preboot volume directories are named by volume UUIDs.
+  //
+  if (Length - Start == 36
+    && FileName[Start + 8] == L'-'
+    && FileName[Start + 13] == L'-'
+    && FileName[Start + 18] == L'-'
+    && FileName[Start + 23] == L'-') {
+    return TRUE;
+  }
+
+  for (Index = 0; Index < ARRAY_SIZE (mOcKernelPathNames); ++Index) {
+    if (mOcKernelPathNames[Index].Length != Length - Start) {
+      continue;
+    }
+
+    for (Index2 = 0; Index2 < Length - Start; ++Index2) {
+      if (CharToUpper (FileName[Start + Index2]) != CharToUpper (mOcKernelPathNames[Index].Name[Index2])) {
+        break;
+      }
+    }
+
+    if (Index2 == Length - Start) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
 STATIC
 EFI_STATUS
 EFIAPI
@@ -657,6 +1756,10 @@ OcKernelFileOpen (
   EFI_STATUS         PrelinkedStatus;
   EFI_TIME           ModificationTime;
   UINT32             DarwinVersion;
+  UINT32             ReserveSize;
+  BOOLEAN            FromCache;
+  BOOLEAN            SaveCache;
+  UINT8              CacheKey[SHA256_DIGEST_SIZE];
 
   Status = This->Open (This, NewHandle, FileName, OpenMode, Attributes);
 
@@ -681,32 +1784,91 @@ OcKernelFileOpen (
     && StrStr (FileName, L"kernel") != NULL
     && StrCmp (FileName, L"System\\Library\\Kernels\\kernel") != 0) {
 
-    DEBUG ((DEBUG_INFO, "Trying XNU hook on %s\n", FileName));
-    Status = ReadAppleKernel (
-      *NewHandle,
-      &Kernel,
-      &KernelSize,
-      &AllocatedSize,
-      OcKernelLoadKextsAndReserve (mOcStorage, mOcConfiguration)
-      );
-    DEBUG ((DEBUG_INFO, "Result of XNU hook on %s is %r\n", FileName, Status));
+    DEBUG ((
+      DEBUG_INFO,
+      "Trying XNU hook on %s after %u wrapped and %u raw handles\n",
+      FileName,
+      mOcKernelWrappedHandles,
+      mOcKernelRawHandles
+      ));
+    FromCache = FALSE;
+    SaveCache = FALSE;
+
+    OcTimingStart (OcTimingKernelRead);
 
     //
-    // This is not Apple kernel, just return the original file.
+    // Cache key only samples raw kernel and kexts, so a hit needs neither
+    // of them to be read in full.
     //
-    if (!EFI_ERROR (Status)) {
-      DarwinVersion = OcKernelReadDarwinVersion (Kernel, KernelSize);
-      OcKernelApplyPatches (mOcConfiguration, DarwinVersion, NULL, Kernel, KernelSize);
-
-      PrelinkedStatus = OcKernelProcessPrelinked (
+    if (mOcKernelCacheEnabled) {
+      Status = OcKernelCacheGetKey (
         mOcConfiguration,
-        DarwinVersion,
-        Kernel,
+        mOcStorage,
+        mOcCpuInfo,
+        FileName,
+        *NewHandle,
+        CacheKey
+        );
+      if (!EFI_ERROR (Status)) {
+        Status    = OcKernelCacheLoad (mOcStorage, CacheKey, &Kernel, &KernelSize);
+        FromCache = !EFI_ERROR (Status);
+        //
+        // Multi-megabyte cache is only rewritten when it is stale or unusable,
+        // not when it merely failed to be read this time.
+        //
+        SaveCache = Status == EFI_NOT_FOUND
+          || Status == EFI_VOLUME_CORRUPTED
+          || Status == EFI_SECURITY_VIOLATION;
+      }
+      DEBUG ((DEBUG_INFO, "OC: Kernel cache lookup for %s - %r\n", FileName, Status));
+    }
+
+    if (!FromCache) {
+      OcTimingStop (OcTimingKernelRead);
+      ReserveSize = OcKernelLoadKextsAndReserve (mOcStorage, mOcConfiguration);
+      OcTimingStart (OcTimingKernelRead);
+
+      Status = ReadAppleKernel (
+        *NewHandle,
+        &Kernel,
         &KernelSize,
-        AllocatedSize
+        &AllocatedSize,
+        ReserveSize
         );
+      DEBUG ((DEBUG_INFO, "Result of XNU hook on %s is %r\n", FileName, Status));
+    }
+
+    OcTimingStop (OcTimingKernelRead);
+
+    //
+    // This is not Apple kernel, just return the original file.
+    //
+    if (!EFI_ERROR (Status)) {
+      if (!FromCache) {
+        DarwinVersion = OcKernelReadDarwinVersion (Kernel, KernelSize);
+        OcTimingStart (OcTimingKernelPatch);
+        OcKernelApplyPatches (mOcConfiguration, DarwinVersion, NULL, NULL, Kernel, KernelSize);
+        OcTimingStop (OcTimingKernelPatch);
+
+        PrelinkedStatus = OcKernelProcessPrelinked (
+          mOcConfiguration,
+          DarwinVersion,
+          Kernel,
+          &KernelSize,
+          AllocatedSize
+          );
+
+        DEBUG ((DEBUG_INFO, "Prelinked status - %r\n", PrelinkedStatus));
 
-      DEBUG ((DEBUG_INFO, "Prelinked status - %r\n", PrelinkedStatus));
+        //
+        // Only fully processed prelinked kernels are worth caching.
+        //
+        if (SaveCache && !EFI_ERROR (PrelinkedStatus)) {
+          OcKernelCacheSave (mOcStorage, CacheKey, Kernel, KernelSize);
+        }
+      }
+
+      OcTimingExport (mOcCpuInfo->TSCFrequency);
 
       Status = GetFileModifcationTime (*NewHandle, &ModificationTime);
       if (EFI_ERROR (Status)) {
@@ -743,7 +1905,14 @@ OcKernelFileOpen (
 
   //
   // We recurse the filtering to additionally catch com.apple.boot.[RPS] directories.
+  // Other files and directories cannot lead to a kernel and are returned as is.
   //
+  if (!OcKernelIsKernelPath (FileName)) {
+    ++mOcKernelRawHandles;
+    return EFI_SUCCESS;
+  }
+
+  ++mOcKernelWrappedHandles;
   return CreateRealFile (*NewHandle, OcKernelFileOpen, TRUE, NewHandle);
 }
 
@@ -756,14 +1925,26 @@ OcLoadKernelSupport (
 {
   EFI_STATUS  Status;
 
+  //
+  // Kernel hooks parse the configuration on their own when it cannot be compiled.
+  //
+  Status = OcKernelCompileConfig (Config);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_WARN, "OC: Failed to compile kernel config, using slow path - %r\n", Status));
+  }
+
   Status = EnableVirtualFs (gBS, OcKernelFileOpen);
 
   if (!EFI_ERROR (Status)) {
     mOcStorage       = Storage;
     mOcConfiguration = Config;
     mOcCpuInfo       = CpuInfo;
+
+    mOcKernelCacheEnabled = OcKernelCacheIsEnabled (Storage);
+    DEBUG ((DEBUG_INFO, "OC: Kernel cache is %a\n", mOcKernelCacheEnabled ? "enabled" : "disabled"));
   } else {
     DEBUG ((DEBUG_ERROR, "OC: Failed to enable vfs - %r\n", Status));
+    OcKernelFreeCompiledConfig ();
   }
 }
 
@@ -781,5 +1962,6 @@ OcUnloadKernelSupport (
     }
     mOcStorage       = NULL;
     mOcConfiguration = NULL;
+    OcKernelFreeCompiledConfig ();
   }
 }
@@ -0,0 +1,959 @@
+/** @file
+  OpenCore driver.
+
+Copyright (c) 2019, vit9696. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include <OpenCore.h>
+
+#include <Guid/OcVariables.h>
+
+#include <Library/BaseLib.h>
+#include <Library/BaseMemoryLib.h>
+#include <Library/DebugLib.h>
+#include <Library/MemoryAllocationLib.h>
+#include <Library/OcFileLib.h>
+#include <Library/PrintLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
+
+/**
+  Kernel cache file signature.
+**/
+#define OC_KERNEL_CACHE_SIGNATURE  SIGNATURE_32 ('O', 'C', 'K', 'C')
+
+/**
+  Kernel cache format version, bump on incompatible changes.
+**/
+#define OC_KERNEL_CACHE_VERSION    3
+
+/**
+  Variable pinning kernel cache digest when vault is used.
+**/
+#define OC_KERNEL_CACHE_VARIABLE_NAME  L"opencore-kernel-cache"
+
+/**
+  Amount of bytes hashed from the start and the end of kernel and kext
+  executables. Mach-O load commands with LC_UUID and compressed prelinked
+  kernel header with image checksum reside within the first page.
+**/
+#define OC_KERNEL_CACHE_SAMPLE_SIZE  4096
+
+/**
+  Patch hint file signature.
+**/
+#define OC_KERNEL_HINTS_SIGNATURE  SIGNATURE_32 ('O', 'C', 'K', 'H')
+
+/**
+  Patch hint format version, bump on incompatible changes.
+**/
+#define OC_KERNEL_HINTS_VERSION    1
+
+/**
+  Maximum amount of patch hint records kept from previous boots.
+**/
+#define OC_KERNEL_HINTS_MAX_RECORDS  64
+
+/**
+  Variable pinning patch hint digest when vault is used.
+**/
+#define OC_KERNEL_HINTS_VARIABLE_NAME  L"opencore-kernel-hints"
+
+/**
+  Kernel cache file header.
+**/
+typedef struct {
+  ///
+  /// OC_KERNEL_CACHE_SIGNATURE.
+  ///
+  UINT32  Signature;
+  ///
+  /// OC_KERNEL_CACHE_VERSION.
+  ///
+  UINT32  Version;
+  ///
+  /// Size of cached kernel following the header.
+  ///
+  UINT32  KernelSize;
+  ///
+  /// Reserved for future use, zero.
+  ///
+  UINT32  Reserved;
+  ///
+  /// Cache key the kernel was produced for.
+  ///
+  UINT8   Key[SHA256_DIGEST_SIZE];
+} OC_KERNEL_CACHE_HEADER;
+
+/**
+  Patch hint file header.
+**/
+typedef struct {
+  ///
+  /// OC_KERNEL_HINTS_SIGNATURE.
+  ///
+  UINT32  Signature;
+  ///
+  /// OC_KERNEL_HINTS_VERSION.
+  ///
+  UINT32  Version;
+  ///
+  /// Amount of records following the header.
+  ///
+  UINT32  RecordCount;
+  ///
+  /// Reserved for future use, zero.
+  ///
+  UINT32  Reserved;
+} OC_KERNEL_HINTS_HEADER;
+
+/**
+  Patch hint record, followed by Count OC_BATCH_PATCH_HINT entries.
+**/
+typedef struct {
+  ///
+  /// Hint key the entries were recorded for.
+  ///
+  UINT8   Key[SHA256_DIGEST_SIZE];
+  ///
+  /// Amount of entries.
+  ///
+  UINT32  Count;
+  ///
+  /// Reserved for future use, zero.
+  ///
+  UINT32  Reserved;
+} OC_KERNEL_HINTS_RECORD;
+
+STATIC UINT8    mOcKernelCacheConfigDigest[SHA256_DIGEST_SIZE];
+STATIC BOOLEAN  mOcKernelCacheHasConfigDigest;
+
+STATIC
+VOID
+OcKernelCacheHashBuffer (
+  IN OUT SHA256_CONTEXT  *Context,
+  IN     CONST VOID      *Buffer,
+  IN     UINT32          BufferSize
+  )
+{
+  //
+  // Hash size first to make concatenations unambiguous.
+  //
+  Sha256Update (Context, (CONST UINT8 *) &BufferSize, sizeof (BufferSize));
+  if (BufferSize > 0) {
+    Sha256Update (Context, Buffer, BufferSize);
+  }
+}
+
+/**
+  Hash file data in chunks, so that no allocation is needed.
+**/
+STATIC
+EFI_STATUS
+OcKernelCacheHashFileData (
+  IN OUT SHA256_CONTEXT     *Context,
+  IN     EFI_FILE_PROTOCOL  *File,
+  IN     UINT32             Position,
+  IN     UINT32             Size
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      ChunkSize;
+  UINT8       Buffer[OC_KERNEL_CACHE_SAMPLE_SIZE];
+
+  while (Size > 0) {
+    ChunkSize = MIN (Size, sizeof (Buffer));
+    Status    = GetFileData (File, Position, ChunkSize, Buffer);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    Sha256Update (Context, Buffer, ChunkSize);
+    Position += ChunkSize;
+    Size     -= ChunkSize;
+  }
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Hash file size, modification time, and contents. When sampling is requested
+  only OC_KERNEL_CACHE_SAMPLE_SIZE bytes from file start and end are hashed.
+  Missing files are hashed as empty, so that they keep producing the same key.
+**/
+STATIC
+EFI_STATUS
+OcKernelCacheHashFile (
+  IN OUT SHA256_CONTEXT     *Context,
+  IN     EFI_FILE_PROTOCOL  *File  OPTIONAL,
+  IN     BOOLEAN            Sample
+  )
+{
+  EFI_STATUS  Status;
+  UINT32      FileSize;
+  EFI_TIME    ModificationTime;
+
+  FileSize = 0;
+  ZeroMem (&ModificationTime, sizeof (ModificationTime));
+
+  if (File != NULL) {
+    Status = GetFileSize (File, &FileSize);
+    if (!EFI_ERROR (Status)) {
+      Status = GetFileModifcationTime (File, &ModificationTime);
+    }
+
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  OcKernelCacheHashBuffer (Context, &FileSize, sizeof (FileSize));
+  OcKernelCacheHashBuffer (Context, &ModificationTime, sizeof (ModificationTime));
+
+  if (File == NULL) {
+    return EFI_SUCCESS;
+  }
+
+  if (!Sample || FileSize <= 2 * OC_KERNEL_CACHE_SAMPLE_SIZE) {
+    return OcKernelCacheHashFileData (Context, File, 0, FileSize);
+  }
+
+  Status = OcKernelCacheHashFileData (Context, File, 0, OC_KERNEL_CACHE_SAMPLE_SIZE);
+  if (!EFI_ERROR (Status)) {
+    Status = OcKernelCacheHashFileData (
+      Context,
+      File,
+      FileSize - OC_KERNEL_CACHE_SAMPLE_SIZE,
+      OC_KERNEL_CACHE_SAMPLE_SIZE
+      );
+  }
+
+  return Status;
+}
+
+STATIC
+EFI_STATUS
+OcKernelCacheHashStorageFile (
+  IN OUT SHA256_CONTEXT      *Context,
+  IN     OC_STORAGE_CONTEXT  *Storage,
+  IN     CHAR16              *Path,
+  IN     BOOLEAN             Sample
+  )
+{
+  EFI_STATUS         Status;
+  EFI_FILE_PROTOCOL  *File;
+
+  OcKernelCacheHashBuffer (Context, Path, (UINT32) StrSize (Path));
+
+  Status = Storage->StorageRoot->Open (
+    Storage->StorageRoot,
+    &File,
+    Path,
+    EFI_FILE_MODE_READ,
+    0
+    );
+
+  if (EFI_ERROR (Status)) {
+    return OcKernelCacheHashFile (Context, NULL, Sample);
+  }
+
+  Status = OcKernelCacheHashFile (Context, File, Sample);
+  File->Close (File);
+
+  return Status;
+}
+
+/**
+  Calculate digest of configuration and enabled kexts once per boot.
+  Whole config is covered as we do not know which settings the kernel
+  patches depend on, yet it is small. Kext plists are hashed fully and
+  kext executables are sampled. The digest is reused by later kernel opens,
+  which also keeps it independent of kexts disabled during kext loading.
+**/
+STATIC
+EFI_STATUS
+OcKernelCacheGetConfigDigest (
+  IN  OC_GLOBAL_CONFIG    *Config,
+  IN  OC_STORAGE_CONTEXT  *Storage
+  )
+{
+  EFI_STATUS           Status;
+  SHA256_CONTEXT       Context;
+  UINT32               Index;
+  CHAR8                *BundlePath;
+  CHAR8                *ExecutablePath;
+  CHAR16               FullPath[128];
+  OC_KERNEL_ADD_ENTRY  *Kext;
+
+  if (mOcKernelCacheHasConfigDigest) {
+    return EFI_SUCCESS;
+  }
+
+  Sha256Init (&Context);
+
+  Status = OcKernelCacheHashStorageFile (&Context, Storage, OPEN_CORE_CONFIG_PATH, FALSE);
+
+  for (Index = 0; Index < Config->Kernel.Add.Count && !EFI_ERROR (Status); ++Index) {
+    Kext = Config->Kernel.Add.Values[Index];
+    if (!Kext->Enabled) {
+      continue;
+    }
+
+    BundlePath     = OC_BLOB_GET (&Kext->BundlePath);
+    ExecutablePath = OC_BLOB_GET (&Kext->ExecutablePath);
+
+    UnicodeSPrint (
+      FullPath,
+      sizeof (FullPath),
+      OPEN_CORE_KEXT_PATH "%a\\%a",
+      BundlePath,
+      OC_BLOB_GET (&Kext->PlistPath)
+      );
+    UnicodeUefiSlashes (FullPath);
+    Status = OcKernelCacheHashStorageFile (&Context, Storage, FullPath, FALSE);
+
+    if (!EFI_ERROR (Status) && ExecutablePath[0] != '\0') {
+      UnicodeSPrint (
+        FullPath,
+        sizeof (FullPath),
+        OPEN_CORE_KEXT_PATH "%a\\%a",
+        BundlePath,
+        ExecutablePath
+        );
+      UnicodeUefiSlashes (FullPath);
+      Status = OcKernelCacheHashStorageFile (&Context, Storage, FullPath, TRUE);
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Sha256Final (&Context, mOcKernelCacheConfigDigest);
+  mOcKernelCacheHasConfigDigest = TRUE;
+
+  return EFI_SUCCESS;
+}
+
+STATIC
+VOID
+OcKernelCacheGetDigest (
+  IN  CONST OC_KERNEL_CACHE_HEADER  *Header,
+  IN  CONST UINT8                   *Kernel,
+  OUT UINT8                         *Digest
+  )
+{
+  SHA256_CONTEXT  Context;
+
+  Sha256Init (&Context);
+  Sha256Update (&Context, (CONST UINT8 *) Header, sizeof (*Header));
+  Sha256Update (&Context, Kernel, Header->KernelSize);
+  Sha256Final (&Context, Digest);
+}
+
+BOOLEAN
+OcKernelCacheIsEnabled (
+  IN OC_STORAGE_CONTEXT  *Storage
+  )
+{
+  EFI_STATUS         Status;
+  EFI_FILE_PROTOCOL  *Directory;
+
+  if (Storage->StorageRoot == NULL) {
+    return FALSE;
+  }
+
+  Status = Storage->StorageRoot->Open (
+    Storage->StorageRoot,
+    &Directory,
+    OPEN_CORE_KERNEL_CACHE_PATH,
+    EFI_FILE_MODE_READ,
+    0
+    );
+
+  if (EFI_ERROR (Status)) {
+    return FALSE;
+  }
+
+  Directory->Close (Directory);
+  return TRUE;
+}
+
+EFI_STATUS
+OcKernelCacheGetKey (
+  IN  OC_GLOBAL_CONFIG    *Config,
+  IN  OC_STORAGE_CONTEXT  *Storage,
+  IN  OC_CPU_INFO         *CpuInfo,
+  IN  CONST CHAR16        *FileName,
+  IN  EFI_FILE_PROTOCOL   *File,
+  OUT UINT8               *Key
+  )
+{
+  EFI_STATUS      Status;
+  SHA256_CONTEXT  Context;
+  UINT32          Hash;
+  CONST CHAR16    *Walker;
+
+  //
+  // boot.efi tries several kernel files, each of them gets its own key.
+  //
+  Hash = 2166136261U;
+  for (Walker = FileName; *Walker != L'\0'; ++Walker) {
+    Hash = (Hash ^ (UINT16) CharToUpper (*Walker)) * 16777619U;
+  }
+
+  Sha256Init (&Context);
+  OcKernelCacheHashBuffer (&Context, OPEN_CORE_VERSION, L_STR_SIZE (OPEN_CORE_VERSION));
+  OcKernelCacheHashBuffer (&Context, &Hash, sizeof (Hash));
+
+  //
+  // Raw kernel is only sampled, so that a cache hit does not read it.
+  //
+  Status = OcKernelCacheHashFile (&Context, File, TRUE);
+  File->SetPosition (File, 0);
+  if (!EFI_ERROR (Status)) {
+    Status = OcKernelCacheGetConfigDigest (Config, Storage);
+  }
+
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  OcKernelCacheHashBuffer (&Context, mOcKernelCacheConfigDigest, sizeof (mOcKernelCacheConfigDigest));
+
+  //
+  // CPUID emulation depends on the actual CPU.
+  //
+  OcKernelCacheHashBuffer (&Context, &CpuInfo->CpuidVerEax, sizeof (CpuInfo->CpuidVerEax));
+  OcKernelCacheHashBuffer (&Context, &CpuInfo->CpuidVerEbx, sizeof (CpuInfo->CpuidVerEbx));
+  OcKernelCacheHashBuffer (&Context, &CpuInfo->CpuidVerEcx, sizeof (CpuInfo->CpuidVerEcx));
+  OcKernelCacheHashBuffer (&Context, &CpuInfo->CpuidVerEdx, sizeof (CpuInfo->CpuidVerEdx));
+
+  Sha256Final (&Context, Key);
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+OcKernelCacheLoad (
+  IN  OC_STORAGE_CONTEXT  *Storage,
+  IN  CONST UINT8         *Key,
+  OUT UINT8               **Kernel,
+  OUT UINT32              *KernelSize
+  )
+{
+  EFI_STATUS              Status;
+  EFI_FILE_PROTOCOL       *File;
+  UINT32                  FileSize;
+  OC_KERNEL_CACHE_HEADER  Header;
+  UINT8                   Digest[SHA256_DIGEST_SIZE];
+  UINT8                   PinnedDigest[SHA256_DIGEST_SIZE];
+  UINTN                   PinnedDigestSize;
+
+  Status = Storage->StorageRoot->Open (
+    Storage->StorageRoot,
+    &File,
+    OPEN_CORE_KERNEL_CACHE_FILE,
+    EFI_FILE_MODE_READ,
+    0
+    );
+
+  if (EFI_ERROR (Status)) {
+    return EFI_NOT_FOUND;
+  }
+
+  Status = GetFileSize (File, &FileSize);
+  if (!EFI_ERROR (Status) && FileSize > sizeof (Header)) {
+    Status = GetFileData (File, 0, sizeof (Header), &Header);
+  } else {
+    Status = EFI_VOLUME_CORRUPTED;
+  }
+
+  if (!EFI_ERROR (Status)
+    && (Header.Signature != OC_KERNEL_CACHE_SIGNATURE
+      || Header.Version != OC_KERNEL_CACHE_VERSION
+      || Header.KernelSize != FileSize - sizeof (Header))) {
+    Status = EFI_VOLUME_CORRUPTED;
+  }
+
+  if (!EFI_ERROR (Status) && CompareMem (Header.Key, Key, sizeof (Header.Key)) != 0) {
+    Status = EFI_NOT_FOUND;
+  }
+
+  *Kernel = NULL;
+  if (!EFI_ERROR (Status)) {
+    *Kernel = AllocatePool (Header.KernelSize);
+    if (*Kernel != NULL) {
+      Status = GetFileData (File, sizeof (Header), Header.KernelSize, *Kernel);
+    } else {
+      Status = EFI_OUT_OF_RESOURCES;
+    }
+  }
+
+  File->Close (File);
+
+  //
+  // Vault cannot sign the image at boot time without the private key, so
+  // its digest is pinned in a variable inaccessible after ExitBootServices.
+  //
+  if (!EFI_ERROR (Status) && Storage->HasVault) {
+    OcKernelCacheGetDigest (&Header, *Kernel, Digest);
+    PinnedDigestSize = sizeof (PinnedDigest);
+    Status = gRT->GetVariable (
+      OC_KERNEL_CACHE_VARIABLE_NAME,
+      &gOcVendorVariableGuid,
+      NULL,
+      &PinnedDigestSize,
+      PinnedDigest
+      );
+    if (!EFI_ERROR (Status)
+      && (PinnedDigestSize != sizeof (PinnedDigest)
+        || CompareMem (Digest, PinnedDigest, sizeof (Digest)) != 0)) {
+      Status = EFI_SECURITY_VIOLATION;
+    }
+  }
+
+  if (EFI_ERROR (Status)) {
+    if (*Kernel != NULL) {
+      FreePool (*Kernel);
+      *Kernel = NULL;
+    }
+    return Status;
+  }
+
+  *KernelSize = Header.KernelSize;
+  return EFI_SUCCESS;
+}
+
+VOID
+OcKernelCacheSave (
+  IN OC_STORAGE_CONTEXT  *Storage,
+  IN CONST UINT8         *Key,
+  IN UINT8               *Kernel,
+  IN UINT32              KernelSize
+  )
+{
+  EFI_STATUS              Status;
+  EFI_FILE_PROTOCOL       *File;
+  OC_KERNEL_CACHE_HEADER  Header;
+  UINT8                   Digest[SHA256_DIGEST_SIZE];
+  UINTN                   Size;
+
+  ZeroMem (&Header, sizeof (Header));
+  Header.Signature  = OC_KERNEL_CACHE_SIGNATURE;
+  Header.Version    = OC_KERNEL_CACHE_VERSION;
+  Header.KernelSize = KernelSize;
+  CopyMem (Header.Key, Key, sizeof (Header.Key));
+
+  //
+  // Drop previous cache first, file protocol cannot truncate on open.
+  //
+  Status = Storage->StorageRoot->Open (
+    Storage->StorageRoot,
+    &File,
+    OPEN_CORE_KERNEL_CACHE_FILE,
+    EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE,
+    0
+    );
+  if (!EFI_ERROR (Status)) {
+    File->Delete (File);
+  }
+
+  if (Storage->HasVault) {
+    OcKernelCacheGetDigest (&Header, Kernel, Digest);
+    Status = gRT->SetVariable (
+      OC_KERNEL_CACHE_VARIABLE_NAME,
+      &gOcVendorVariableGuid,
+      OPEN_CORE_INT_NVRAM_ATTR | EFI_VARIABLE_NON_VOLATILE,
+      sizeof (Digest),
+      Digest
+      );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_INFO, "OC: Failed to pin kernel cache - %r\n", Status));
+      return;
+    }
+  }
+
+  Status = Storage->StorageRoot->Open (
+    Storage->StorageRoot,
+    &File,
+    OPEN_CORE_KERNEL_CACHE_FILE,
+    EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+    0
+    );
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_INFO, "OC: Failed to create kernel cache - %r\n", Status));
+    return;
+  }
+
+  Size   = sizeof (Header);
+  Status = File->Write (File, &Size, &Header);
+  if (!EFI_ERROR (Status)) {
+    Size   = KernelSize;
+    Status = File->Write (File, &Size, Kernel);
+  }
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_INFO, "OC: Failed to write kernel cache - %r\n", Status));
+    File->Delete (File);
+    return;
+  }
+
+  File->Close (File);
+  DEBUG ((DEBUG_INFO, "OC: Saved kernel cache of %u bytes\n", KernelSize));
+}
+
+VOID
+OcKernelCacheGetHintKey (
+  IN  CONST UINT8           *Uuid,
+  IN  UINT32                UuidSize,
+  IN  UINT32                DataSize,
+  IN  CONST OC_BATCH_PATCH  *Patches,
+  IN  UINT32                PatchCount,
+  OUT UINT8                 *Key
+  )
+{
+  SHA256_CONTEXT  Context;
+  UINT32          Index;
+  UINT32          Size;
+
+  Sha256Init (&Context);
+  OcKernelCacheHashBuffer (&Context, Uuid, UuidSize);
+  OcKernelCacheHashBuffer (&Context, &DataSize, sizeof (DataSize));
+
+  for (Index = 0; Index < PatchCount; ++Index) {
+    Size = Patches[Index].Size;
+    OcKernelCacheHashBuffer (&Context, Patches[Index].Find, Size);
+    OcKernelCacheHashBuffer (&Context, Patches[Index].Mask, Patches[Index].Mask != NULL ? Size : 0);
+    OcKernelCacheHashBuffer (&Context, Patches[Index].Replace, Size);
+    OcKernelCacheHashBuffer (&Context, Patches[Index].ReplaceMask, Patches[Index].ReplaceMask != NULL ? Size : 0);
+    OcKernelCacheHashBuffer (&Context, &Patches[Index].Count, sizeof (Patches[Index].Count));
+    OcKernelCacheHashBuffer (&Context, &Patches[Index].Skip, sizeof (Patches[Index].Skip));
+    OcKernelCacheHashBuffer (&Context, &Patches[Index].Limit, sizeof (Patches[Index].Limit));
+  }
+
+  Sha256Final (&Context, Key);
+}
+
+/**
+  Validate hint file layout, so that lookups need no further checks.
+**/
+STATIC
+BOOLEAN
+OcKernelCacheHintsValid (
+  IN CONST VOID  *Hints,
+  IN UINT32      HintsSize
+  )
+{
+  CONST OC_KERNEL_HINTS_HEADER  *Header;
+  CONST OC_KERNEL_HINTS_RECORD  *Record;
+  UINT32                        Offset;
+  UINT32                        Index;
+
+  if (HintsSize < sizeof (*Header)) {
+    return FALSE;
+  }
+
+  Header = Hints;
+  if (Header->Signature != OC_KERNEL_HINTS_SIGNATURE
+    || Header->Version != OC_KERNEL_HINTS_VERSION) {
+    return FALSE;
+  }
+
+  Offset = sizeof (*Header);
+  for (Index = 0; Index < Header->RecordCount; ++Index) {
+    if (HintsSize - Offset < sizeof (*Record)) {
+      return FALSE;
+    }
+
+    Record  = (CONST OC_KERNEL_HINTS_RECORD *) ((CONST UINT8 *) Hints + Offset);
+    Offset += sizeof (*Record);
+
+    if (Record->Count > (HintsSize - Offset) / sizeof (OC_BATCH_PATCH_HINT)) {
+      return FALSE;
+    }
+
+    Offset += Record->Count * sizeof (OC_BATCH_PATCH_HINT);
+  }
+
+  return Offset == HintsSize;
+}
+
+EFI_STATUS
+OcKernelCacheLoadHints (
+  IN  OC_STORAGE_CONTEXT  *Storage,
+  OUT VOID                **Hints,
+  OUT UINT32              *HintsSize
+  )
+{
+  EFI_STATUS         Status;
+  EFI_FILE_PROTOCOL  *File;
+  SHA256_CONTEXT     Context;
+  UINT8              Digest[SHA256_DIGEST_SIZE];
+  UINT8              PinnedDigest[SHA256_DIGEST_SIZE];
+  UINTN              PinnedDigestSize;
+
+  *Hints = NULL;
+
+  Status = Storage->StorageRoot->Open (
+    Storage->StorageRoot,
+    &File,
+    OPEN_CORE_KERNEL_HINTS_FILE,
+    EFI_FILE_MODE_READ,
+    0
+    );
+
+  if (EFI_ERROR (Status)) {
+    return EFI_NOT_FOUND;
+  }
+
+  Status = GetFileSize (File, HintsSize);
+  if (!EFI_ERROR (Status) && *HintsSize > 0) {
+    *Hints = AllocatePool (*HintsSize);
+    if (*Hints != NULL) {
+      Status = GetFileData (File, 0, *HintsSize, *Hints);
+    } else {
+      Status = EFI_OUT_OF_RESOURCES;
+    }
+  } else {
+    Status = EFI_VOLUME_CORRUPTED;
+  }
+
+  File->Close (File);
+
+  if (!EFI_ERROR (Status) && !OcKernelCacheHintsValid (*Hints, *HintsSize)) {
+    Status = EFI_VOLUME_CORRUPTED;
+  }
+
+  if (!EFI_ERROR (Status) && Storage->HasVault) {
+    Sha256Init (&Context);
+    Sha256Update (&Context, *Hints, *HintsSize);
+    Sha256Final (&Context, Digest);
+
+    PinnedDigestSize = sizeof (PinnedDigest);
+    Status = gRT->GetVariable (
+      OC_KERNEL_HINTS_VARIABLE_NAME,
+      &gOcVendorVariableGuid,
+      NULL,
+      &PinnedDigestSize,
+      PinnedDigest
+      );
+    if (!EFI_ERROR (Status)
+      && (PinnedDigestSize != sizeof (PinnedDigest)
+        || CompareMem (Digest, PinnedDigest, sizeof (Digest)) != 0)) {
+      Status = EFI_SECURITY_VIOLATION;
+    }
+  }
+
+  if (EFI_ERROR (Status) && *Hints != NULL) {
+    FreePool (*Hints);
+    *Hints = NULL;
+  }
+
+  return Status;
+}
+
+BOOLEAN
+OcKernelCacheFindHints (
+  IN  CONST VOID                 *Hints,
+  IN  UINT32                     HintsSize,
+  IN  CONST UINT8                *Key,
+  OUT CONST OC_BATCH_PATCH_HINT  **Entries,
+  OUT UINT32                     *Count
+  )
+{
+  CONST OC_KERNEL_HINTS_HEADER  *Header;
+  CONST OC_KERNEL_HINTS_RECORD  *Record;
+  CONST UINT8                   *Walker;
+  UINT32                        Index;
+
+  if (Hints == NULL) {
+    return FALSE;
+  }
+
+  Header = Hints;
+  Walker = (CONST UINT8 *) Hints + sizeof (*Header);
+
+  for (Index = 0; Index < Header->RecordCount; ++Index) {
+    Record = (CONST OC_KERNEL_HINTS_RECORD *) Walker;
+    Walker += sizeof (*Record);
+
+    if (CompareMem (Record->Key, Key, sizeof (Record->Key)) == 0) {
+      *Entries = (CONST OC_BATCH_PATCH_HINT *) Walker;
+      *Count   = Record->Count;
+      return TRUE;
+    }
+
+    Walker += Record->Count * sizeof (OC_BATCH_PATCH_HINT);
+  }
+
+  return FALSE;
+}
+
+EFI_STATUS
+OcKernelCacheMergeHints (
+  IN OUT VOID        **Hints,
+  IN OUT UINT32      *HintsSize,
+  IN     CONST VOID  *OldHints,
+  IN     UINT32      OldHintsSize
+  )
+{
+  EFI_STATUS                    Status;
+  CONST OC_KERNEL_HINTS_HEADER  *Header;
+  CONST OC_KERNEL_HINTS_RECORD  *Record;
+  CONST UINT8                   *Walker;
+  CONST OC_BATCH_PATCH_HINT     *Entries;
+  UINT32                        Count;
+  UINT32                        Index;
+
+  if (OldHints == NULL) {
+    return EFI_SUCCESS;
+  }
+
+  Header = OldHints;
+  Walker = (CONST UINT8 *) OldHints + sizeof (*Header);
+
+  for (Index = 0; Index < Header->RecordCount; ++Index) {
+    Record = (CONST OC_KERNEL_HINTS_RECORD *) Walker;
+    Walker += sizeof (*Record) + Record->Count * sizeof (OC_BATCH_PATCH_HINT);
+
+    if (*Hints != NULL
+      && ((CONST OC_KERNEL_HINTS_HEADER *) *Hints)->RecordCount >= OC_KERNEL_HINTS_MAX_RECORDS) {
+      break;
+    }
+
+    if (OcKernelCacheFindHints (*Hints, *HintsSize, Record->Key, &Entries, &Count)) {
+      continue;
+    }
+
+    Status = OcKernelCacheAddHints (
+      Hints,
+      HintsSize,
+      Record->Key,
+      (CONST OC_BATCH_PATCH_HINT *) (Record + 1),
+      Record->Count
+      );
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+OcKernelCacheAddHints (
+  IN OUT VOID                       **Hints,
+  IN OUT UINT32                     *HintsSize,
+  IN     CONST UINT8                *Key,
+  IN     CONST OC_BATCH_PATCH_HINT  *Entries,
+  IN     UINT32                     Count
+  )
+{
+  UINT8                   *NewHints;
+  UINT32                  NewHintsSize;
+  OC_KERNEL_HINTS_HEADER  *Header;
+  OC_KERNEL_HINTS_RECORD  *Record;
+
+  if (*Hints == NULL) {
+    *HintsSize = sizeof (*Header);
+  }
+
+  NewHintsSize = *HintsSize + sizeof (*Record) + Count * sizeof (*Entries);
+  NewHints     = ReallocatePool (*Hints != NULL ? *HintsSize : 0, NewHintsSize, *Hints);
+  if (NewHints == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Header = (OC_KERNEL_HINTS_HEADER *) NewHints;
+  if (*Hints == NULL) {
+    ZeroMem (Header, sizeof (*Header));
+    Header->Signature = OC_KERNEL_HINTS_SIGNATURE;
+    Header->Version   = OC_KERNEL_HINTS_VERSION;
+  }
+
+  Record = (OC_KERNEL_HINTS_RECORD *) (NewHints + *HintsSize);
+  ZeroMem (Record, sizeof (*Record));
+  CopyMem (Record->Key, Key, sizeof (Record->Key));
+  Record->Count = Count;
+  CopyMem (Record + 1, Entries, Count * sizeof (*Entries));
+  ++Header->RecordCount;
+
+  *Hints     = NewHints;
+  *HintsSize = NewHintsSize;
+
+  return EFI_SUCCESS;
+}
+
+VOID
+OcKernelCacheSaveHints (
+  IN OC_STORAGE_CONTEXT  *Storage,
+  IN CONST VOID          *Hints,
+  IN UINT32              HintsSize
+  )
+{
+  EFI_STATUS         Status;
+  EFI_FILE_PROTOCOL  *File;
+  SHA256_CONTEXT     Context;
+  UINT8              Digest[SHA256_DIGEST_SIZE];
+  UINTN              Size;
+
+  Status = Storage->StorageRoot->Open (
+    Storage->StorageRoot,
+    &File,
+    OPEN_CORE_KERNEL_HINTS_FILE,
+    EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE,
+    0
+    );
+  if (!EFI_ERROR (Status)) {
+    File->Delete (File);
+  }
+
+  if (Storage->HasVault) {
+    Sha256Init (&Context);
+    Sha256Update (&Context, Hints, HintsSize);
+    Sha256Final (&Context, Digest);
+
+    Status = gRT->SetVariable (
+      OC_KERNEL_HINTS_VARIABLE_NAME,
+      &gOcVendorVariableGuid,
+      OPEN_CORE_INT_NVRAM_ATTR | EFI_VARIABLE_NON_VOLATILE,
+      sizeof (Digest),
+      Digest
+      );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_INFO, "OC: Failed to pin kernel patch hints - %r\n", Status));
+      return;
+    }
+  }
+
+  Status = Storage->StorageRoot->Open (
+    Storage->StorageRoot,
+    &File,
+    OPEN_CORE_KERNEL_HINTS_FILE,
+    EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE,
+    0
+    );
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_INFO, "OC: Failed to create kernel patch hints - %r\n", Status));
+    return;
+  }
+
+  Size   = HintsSize;
+  Status = File->Write (File, &Size, (VOID *) Hints);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_INFO, "OC: Failed to write kernel patch hints - %r\n", Status));
+    File->Delete (File);
+    return;
+  }
+
+  File->Close (File);
+  DEBUG ((DEBUG_INFO, "OC: Saved kernel patch hints of %u bytes\n", HintsSize));
+}
@@ -29,6 +29,28 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 
 #include <Protocol/OcInterface.h>
 
+STATIC UINT64  mOcTimingStart[OcTimingMax];
+STATIC UINT64  mOcTimingTicks[OcTimingMax];
+
+//
+// Must match OC_TIMING_SPAN order.
+//
+STATIC CONST CHAR8 *mOcTimingNames[OcTimingMax] = {
+  "MiscEarlyInit",
+  "CpuScan",
+  "Uefi",
+  "Acpi",
+  "Platform",
+  "DevProps",
+  "Nvram",
+  "MiscLateInit",
+  "KernelSupport",
+  "KernelRead",
+  "KernelPatch",
+  "KernelBlock",
+  "KernelInject"
+};
+
 STATIC
 VOID
 OcStoreLoadPath (
@@ -415,7 +437,8 @@ OcMiscBoot (
   IN  OC_PRIVILEGE_CONTEXT      *Privilege OPTIONAL,
   IN  OC_IMAGE_START            StartImage,
   IN  BOOLEAN                   CustomBootGuid,
-  IN  EFI_HANDLE                LoadHandle OPTIONAL
+  IN  EFI_HANDLE                LoadHandle OPTIONAL,
+  IN  OC_ARENA                  *Arena
   )
 {
   EFI_STATUS             Status;
@@ -482,7 +505,7 @@ OcMiscBoot (
       sizeof (*BlessOverride),
       &BlessOverrideSize))
     {
-      BlessOverride = AllocateZeroPool (BlessOverrideSize);
+      BlessOverride = OcArenaAllocate (Arena, BlessOverrideSize);
     } else {
       BlessOverride = NULL;
     }
@@ -493,18 +516,17 @@ OcMiscBoot (
       return;
     }
 
+    //
+    // Partially converted overrides stay in the arena until it is freed.
+    //
     for (Index = 0; Index < Config->Misc.BlessOverride.Count; ++Index) {
-      BlessOverride[Index] = AsciiStrCopyToUnicode (
+      BlessOverride[Index] = OcArenaAsciiToUnicode (
+                               Arena,
                                OC_BLOB_GET (
                                  Config->Misc.BlessOverride.Values[Index]
-                                 ),
-                               0
+                                 )
                                );
       if (BlessOverride[Index] == NULL) {
-        for (EntryIndex = 0; EntryIndex < Index; ++EntryIndex) {
-          FreePool (BlessOverride[EntryIndex]);
-        }
-        FreePool (BlessOverride);
         FreePool (Context);
         DEBUG ((DEBUG_ERROR, "OC: Failed to allocate bless overrides!\n"));
         return;
@@ -622,3 +644,58 @@ OcMiscUefiQuirksLoaded (
     );
   OcConsoleDisableCursor ();
 }
+
+VOID
+OcTimingStart (
+  IN OC_TIMING_SPAN  Span
+  )
+{
+  ASSERT (Span < OcTimingMax);
+  mOcTimingStart[Span] = AsmReadTsc ();
+}
+
+VOID
+OcTimingStop (
+  IN OC_TIMING_SPAN  Span
+  )
+{
+  ASSERT (Span < OcTimingMax);
+  mOcTimingTicks[Span] += AsmReadTsc () - mOcTimingStart[Span];
+}
+
+VOID
+OcTimingExport (
+  IN UINT64  TscFrequency
+  )
+{
+  EFI_STATUS        Status;
+  OC_TIMING_RECORD  Record;
+  UINT32            Index;
+
+  Record.Version      = OC_TIMING_RECORD_VERSION;
+  Record.Count        = OcTimingMax;
+  Record.TscFrequency = TscFrequency;
+
+  for (Index = 0; Index < OcTimingMax; ++Index) {
+    Record.Ticks[Index] = mOcTimingTicks[Index];
+    DEBUG ((
+      DEBUG_INFO,
+      "OC: Timing %a - %Lu ticks, %Lu us\n",
+      mOcTimingNames[Index],
+      Record.Ticks[Index],
+      TscFrequency != 0 ? DivU64x64Remainder (MultU64x32 (Record.Ticks[Index], 1000000), TscFrequency, NULL) : 0
+      ));
+  }
+
+  Status = gRT->SetVariable (
+    OC_TIMING_VARIABLE_NAME,
+    &gOcVendorVariableGuid,
+    OPEN_CORE_NVRAM_ATTR,
+    sizeof (Record),
+    &Record
+    );
+
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_INFO, "OC: Failed to store timing - %r\n", Status));
+  }
+}
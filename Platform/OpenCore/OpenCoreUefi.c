@@ -462,6 +462,11 @@ OcLoadBooterUefiSupport (
   AbcSettings.SignalAppleOS          = Config->Booter.Quirks.SignalAppleOS;
 
   if (AbcSettings.DevirtualiseMmio && Config->Booter.MmioWhitelist.Count > 0) {
+    //
+    // This stays in pool rather than in the configuration arena, as
+    // OcAppleBootCompatLib keeps the pointer until ExitBootServices,
+    // past the arena lifetime, and it is a single allocation anyway.
+    //
     AbcSettings.MmioWhitelist = AllocatePool (
       Config->Booter.MmioWhitelist.Count * sizeof (AbcSettings.MmioWhitelist[0])
       );